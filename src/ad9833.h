@@ -0,0 +1,152 @@
+#ifndef QROLLE_AD9833_H
+#define QROLLE_AD9833_H
+
+// Functions for controlling the AD9833 / AD9834 chips on the pin compatible
+// replacement DDS boards. The AD9834 is driven exactly like the AD9833 with
+// its PIN/SW bit left at zero, i.e. register selection, reset and sleep by
+// software. Included through dds.h, which has the pin definitions.
+
+
+#include <inttypes.h>
+
+#include "hal.h"
+
+#include "prof.h"
+
+
+// Typedefs for frequency words and command words
+typedef uint32_t freqword_t;
+typedef uint16_t cmdword_t;
+
+
+// Frequency word width and reference clock
+#define DDS_WORD_BITS 28
+#define DDS_WORD_MAX  0x0FFFFFFFUL
+#ifndef DDS_REF_FREQ
+#define DDS_REF_FREQ  25000000.0
+#endif
+
+
+// Register addresses in the two MSBs (three for phase registers). Frequency
+// writes carry 14 data bits, phase writes 12.
+#define AD_CTRL_REG  0x0000
+#define AD_FREQ0_REG 0x4000
+#define AD_FREQ1_REG 0x8000
+#define AD_PHASE0_REG 0xC000
+#define AD_PHASE1_REG 0xE000
+
+// Control register bits
+#define AD_B28      0x2000 // two consecutive writes load a whole 28-bit word
+#define AD_HLB      0x1000 // with B28 unset, which half a write goes to
+#define AD_FSELECT  0x0800
+#define AD_PSELECT  0x0400
+#define AD_PIN_SW   0x0200 // AD9834 only: select by pins instead of bits
+#define AD_RESET    0x0100 // hold the phase accumulator at zero
+#define AD_SLEEP1   0x0080 // stop the internal MCLK
+#define AD_SLEEP12  0x0040 // power down the DAC
+#define AD_OPBITEN  0x0020
+#define AD_DIV2     0x0008
+#define AD_MODE     0x0002
+
+
+// Shadow of the control register, which is write only
+cmdword_t dds_ctrl;
+
+
+//! \short Put a 16-bit command to the DDS chip.
+//! Big endian. The chip takes SCLK up to 40 MHz, so no delays are needed.
+//! \param word a 16-bit command word
+void dds_put_cmd(cmdword_t cmd)
+{
+	int i;
+	PROF_BEGIN(cmd);
+	
+	// take low the FSYNC signal, clock in 16 bits on the falling edge of
+	// SCLK and take FSYNC high
+	cli();
+	hal_clr(AD_PORT, AD_FSYNC);
+	for (i = 0; i < 16; ++i)
+	{
+		if (cmd & 0x8000)
+			hal_set(AD_PORT, AD_SDATA);
+		else
+			hal_clr(AD_PORT, AD_SDATA);
+		hal_clr(AD_PORT, AD_SCLK);
+		hal_set(AD_PORT, AD_SCLK);
+		cmd <<= 1;
+	}
+	hal_set(AD_PORT, AD_FSYNC);
+	sei();
+
+	PROF_END(cmd, PROF_DDS_CMD);
+}
+
+
+//! \short Put a frequency word to a frequency register
+//! With B28 set the LSB half goes first, the register updates after the
+//! MSB half.
+//! \param reg 0 for FREQ0, 1 for FREQ1
+void dds_put_freqreg(uint8_t reg, freqword_t freq)
+{
+	cmdword_t addr = reg ? AD_FREQ1_REG : AD_FREQ0_REG;
+	dds_put_cmd(addr | (freq & 0x3FFF));
+	dds_put_cmd(addr | ((freq >> 14) & 0x3FFF));
+}
+
+
+//! \short Put a frequency word to the DDS chip
+inline void dds_put_freq(freqword_t freq)
+{
+	dds_put_freqreg(0, freq);
+}
+
+
+//! \short Put a 12-bit phase word to a phase register (0-1)
+void dds_put_phase(uint8_t reg, uint16_t phase)
+{
+	dds_put_cmd((reg ? AD_PHASE1_REG : AD_PHASE0_REG) | (phase & 0x0FFF));
+}
+
+
+//! \short Choose the active frequency and phase registers
+void dds_select(uint8_t freg, uint8_t preg)
+{
+	dds_ctrl &= ~(AD_FSELECT | AD_PSELECT);
+	if (freg)
+		dds_ctrl |= AD_FSELECT;
+	if (preg)
+		dds_ctrl |= AD_PSELECT;
+	dds_put_cmd(AD_CTRL_REG | dds_ctrl);
+}
+
+
+//! \short Power the output down or back up
+void dds_sleep(uint8_t sleep)
+{
+	if (sleep)
+		dds_ctrl |= AD_SLEEP1 | AD_SLEEP12;
+	else
+		dds_ctrl &= ~(AD_SLEEP1 | AD_SLEEP12);
+	dds_put_cmd(AD_CTRL_REG | dds_ctrl);
+}
+
+
+//! \short Initialize the DDS chip.
+//! \param freq the frequency word to come up on
+void dds_init(freqword_t freq)
+{
+	// As specified in the AD9833 application note: hold in reset while
+	// loading the registers, FREQ0 and PHASE0 selected, sine output
+	dds_ctrl = AD_B28 | AD_RESET;
+	dds_put_cmd(AD_CTRL_REG | dds_ctrl);
+	
+	dds_put_freq(freq);
+	dds_put_phase(0, 0);
+	
+	// Return the DDS online
+	dds_ctrl &= ~AD_RESET;
+	dds_put_cmd(AD_CTRL_REG | dds_ctrl);
+}
+
+
+#endif // QROLLE_AD9833_H
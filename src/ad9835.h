@@ -3,6 +3,7 @@
 
 // Functions for controlling the AD9835 chip on QROlle DDS board.
 // Implemented in the headers to let the compiler optimize code better.
+// Included through dds.h, which has the pin definitions.
 //
 // Authors:
 // Antti Nilakari / OH3HMU <anilakar@cc.hut.fi>
@@ -11,18 +12,11 @@
 // 2009-07-05 added more macros. Almost all commands are implemented / AN
  
 
-#include <avr/io.h>
 #include <inttypes.h>
-#include <avr/interrupt.h> 
-#include <util/delay.h>
- 
- 
-// Port and pins for the DDS chip
-#define AD_PORT     PORTB
-#define AD_PORT_DIR DDRB
-#define AD_SCLK     (1 << 2)
-#define AD_SDATA    (1 << 1)
-#define AD_FSYNC    (1 << 0)
+
+#include "hal.h"
+
+#include "prof.h"
 
 
 // Typedefs for frequency words and command words
@@ -30,6 +24,14 @@ typedef uint32_t freqword_t;
 typedef uint16_t cmdword_t;
 
 
+// Frequency word width and reference clock
+#define DDS_WORD_BITS 32
+#define DDS_WORD_MAX  0xFFFFFFFFUL
+#ifndef DDS_REF_FREQ
+#define DDS_REF_FREQ  50000000.0
+#endif
+
+
 // Commands
 
 // 8-bit commands write to the defer register. 16-bit commands write 8 bits
@@ -89,6 +91,15 @@ typedef uint16_t cmdword_t;
 #define AD_FREG0_HLSB 0x0100
 #define AD_FREG0_LMSB 0x0200
 #define AD_FREG0_HMSB 0x0300
+#define AD_FREG1_LLSB 0x0400 
+#define AD_FREG1_HLSB 0x0500
+#define AD_FREG1_LMSB 0x0600
+#define AD_FREG1_HMSB 0x0700
+
+// Phase registers take two addresses each, LSB and MSB, above the
+// frequency registers (A3 set)
+#define AD_PREG_LSB(n) (0x0800 | (n) << 9)
+#define AD_PREG_MSB(n) (0x0800 | (n) << 9 | 0x0100)
 
 
 
@@ -98,57 +109,101 @@ typedef uint16_t cmdword_t;
 void dds_put_cmd(cmdword_t cmd)
 {
 	int i;
+	PROF_BEGIN(cmd);
 	
 	// take low the FSYNC signal, clock in 16 bits on the falling edge of
 	// SCLK and take FSYNC high
 	cli();
-	AD_PORT &= ~AD_FSYNC;
+	hal_clr(AD_PORT, AD_FSYNC);
 	for (i = 0; i < 16; ++i)
 	{
 		if (cmd & 0x8000)
-			AD_PORT |= AD_SDATA;
+			hal_set(AD_PORT, AD_SDATA);
 		else
-			AD_PORT &= ~AD_SDATA;
-		AD_PORT &= ~AD_SCLK;
+			hal_clr(AD_PORT, AD_SDATA);
+		hal_clr(AD_PORT, AD_SCLK);
 		_delay_us(15);
-		AD_PORT |= AD_SCLK;
+		hal_set(AD_PORT, AD_SCLK);
 		cmd <<= 1;
 	}
-	AD_PORT |= AD_FSYNC;
+	hal_set(AD_PORT, AD_FSYNC);
 	sei();
+
+	PROF_END(cmd, PROF_DDS_CMD);
 }
 
 
-//! \short Put a frequency word to the DDS chip
-void dds_put_freq(freqword_t freq)
+//! \short Put a frequency word to a frequency register
+//! \param reg 0 for FREG0, 1 for FREG1
+void dds_put_freqreg(uint8_t reg, freqword_t freq)
 {
 	uint8_t llsb, hlsb, lmsb, hmsb;
+	cmdword_t base = reg ? AD_FREG1_LLSB : AD_FREG0_LLSB;
 	llsb = (freq >> 0) & 0xFF;
 	hlsb = (freq >> 8) & 0xFF;
 	lmsb = (freq >> 16) & 0xFF;
 	hmsb = (freq >> 24) & 0xFF;
 
 	// write using defer registers
-	dds_put_cmd(AD_FREQ8BIT | AD_FREG0_LLSB | llsb);
-	dds_put_cmd(AD_FREQ16BIT | AD_FREG0_HLSB | hlsb);
-	dds_put_cmd(AD_FREQ8BIT | AD_FREG0_LMSB | lmsb);
-	dds_put_cmd(AD_FREQ16BIT | AD_FREG0_HMSB | hmsb);
+	dds_put_cmd(AD_FREQ8BIT | (base + AD_FREG0_LLSB) | llsb);
+	dds_put_cmd(AD_FREQ16BIT | (base + AD_FREG0_HLSB) | hlsb);
+	dds_put_cmd(AD_FREQ8BIT | (base + AD_FREG0_LMSB) | lmsb);
+	dds_put_cmd(AD_FREQ16BIT | (base + AD_FREG0_HMSB) | hmsb);
+}
+
+
+//! \short Put a frequency word to the DDS chip
+inline void dds_put_freq(freqword_t freq)
+{
+	dds_put_freqreg(0, freq);
+}
+
+
+//! \short Put a 12-bit phase word to a phase register (0-3)
+void dds_put_phase(uint8_t reg, uint16_t phase)
+{
+	dds_put_cmd(AD_PHASE8BIT | AD_PREG_LSB(reg) | (phase & 0xFF));
+	dds_put_cmd(AD_PHASE16BIT | AD_PREG_MSB(reg) | ((phase >> 8) & 0x0F));
+}
+
+
+//! \short Choose the active frequency and phase registers
+void dds_select(uint8_t freg, uint8_t preg)
+{
+	cmdword_t cmd = AD_SEL_BOTH_REG;
+	if (freg)
+		cmd |= AD_SEL_FSELECT;
+	if (preg & 1)
+		cmd |= AD_SEL_PSEL0;
+	if (preg & 2)
+		cmd |= AD_SEL_PSEL1;
+	dds_put_cmd(cmd);
+}
+
+
+//! \short Power the output down or back up
+void dds_sleep(uint8_t sleep)
+{
+	dds_put_cmd(AD_CTRL | (sleep ? AD_SLEEP : 0));
 }
 
 
 //! \short Initialize the DDS chip.
-void dds_init(void)
+//! \param freq the frequency word to come up on
+void dds_init(freqword_t freq)
 {
 	// As specified in the AD9835 datasheet
 	
 	// Set the DDS to sleep
 	dds_put_cmd(AD_CTRL | AD_SLEEP | AD_RESET | AD_CLR);
 	
-	// Software source selection not needed in this application
-	// dds_put_cmd(AD_SOURCE);
+	// Select the registers with commands instead of the pins, starting
+	// from FREG0 and PHASE0
+	dds_put_cmd(AD_SOURCE | AD_SELSRC);
+	dds_put_cmd(AD_SEL_BOTH_REG);
 	
 	// Set the initial frequency
-	dds_put_freq(1);
+	dds_put_freq(freq);
 	
 	// Return the DDS online
 	dds_put_cmd(AD_CTRL);
@@ -10,7 +10,11 @@
 // 2009-08-09 Initial version / AN
 
 
-#include <avr/io.h>
+#include "hal.h"
+
+
+// Conversion time in microseconds: 13 ADC clocks at F_CPU / 32
+#define ADC_CONV_US (13UL * 32UL * 1000000UL / F_CPU)
 
 
 //! \short Init the ADC
@@ -19,6 +23,11 @@ void adc_init()
 	// ADLAR == left-adjusted (8-bit accuracy with ADCH only)
 	// MUX[3..0] == ADC input pin
 	ADMUX = (1 << ADLAR) | (1 << MUX0) | (1 << MUX1) | (1 << MUX2) | (1 << MUX3);
+	
+	// Convert continuously at F_CPU / 32, 125 kHz at 4 MHz, so that ADCH
+	// always holds a recent reading
+	ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADFR) |
+	         (1 << ADPS2) | (1 << ADPS0);
 }
 
 //! \short Get a single 8-bit reading from the ADC
@@ -29,5 +38,31 @@ uint8_t adc_getval_8bit()
 }
 
 
+#ifdef QROLLE_HOST
+// Conversions just take their time on the virtual clock
+#define adc_wait() _delay_us(ADC_CONV_US)
+#else
+//! \short Wait for the next conversion to complete.
+void adc_wait()
+{
+	// ADIF is cleared by writing a one to it
+	ADCSRA |= (1 << ADIF);
+	while (!(ADCSRA & (1 << ADIF)))
+		;
+}
+#endif
+
+
+//! \short Get a reading of the input as it is now.
+//! The conversion running at the time of the call may have started before
+//! the input changed, so it is skipped. Takes up to two conversion times.
+uint8_t adc_sample()
+{
+	adc_wait();
+	adc_wait();
+	return ADCH;
+}
+
+
 
 #endif // QROLLE_ADC_H
\ No newline at end of file
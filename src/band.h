@@ -0,0 +1,121 @@
+#ifndef QROLLE_BAND_H
+#define QROLLE_BAND_H
+
+
+// Band table and band-stacking registers.
+//
+// The bands cover the tuning range of the radio without gaps and are sorted
+// by frequency. Each band has its own relay pattern and the sideband and
+// step it starts with. The stacking registers remember where each band was
+// left, including the frequency word, so that a band jump needs no
+// calculation.
+
+
+#include <inttypes.h>
+
+#include "hal.h"
+#include "freq.h"
+
+
+// Band selection relay control pin. High == 20 metres, Low == 80 metres
+#define BAND_SEL_PORT PORTD
+#define BAND_SEL_PINS (1 << 1)
+
+#define BAND_RELAY_80M 0
+#define BAND_RELAY_20M (1 << 1)
+
+#define NUM_BANDS 2
+
+
+// Stored in program memory, read with pgm_read_*()
+typedef struct band_s
+{
+	freq_t low;    // lowest frequency, used for the first band only
+	freq_t high;   // highest frequency
+	freq_t init;   // where the band starts before it has been used
+	uint8_t relay; // BAND_SEL_PORT pattern
+	int8_t usb;    // default sideband
+	int8_t step;   // default step, index to the UI step table
+} band_t;
+
+
+// A band starts where the previous one ends. 100 kHz ... 20 MHz.
+const band_t bands[NUM_BANDS] PROGMEM =
+{
+	{0x00100000UL, 0x10000000UL, 0x03699000UL, BAND_RELAY_80M, 0, 2},
+	{0x10000001UL, 0x20000000UL, 0x14267000UL, BAND_RELAY_20M, 1, 2}
+};
+
+
+// Band-stacking register, the state a band was last left in
+typedef struct band_stack_s
+{
+	freq_t freq;
+	freqword_t word; // frequency word for freq and usb
+	int8_t usb;
+	int8_t step;
+} band_stack_t;
+
+
+band_stack_t band_stack[NUM_BANDS];
+
+
+//! \short Find the band of a frequency.
+//! Binary search over the upper edges. Frequencies outside the table go to
+//! the first or the last band.
+int8_t band_find(freq_t freq)
+{
+	int8_t low = 0;
+	int8_t high = NUM_BANDS - 1;
+
+	while (low < high)
+	{
+		int8_t mid = (low + high) >> 1;
+		if (freq > pgm_read_dword(&bands[mid].high))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+
+//! \short Limit the frequency to the range covered by the bands.
+freq_t band_limit(freq_t freq)
+{
+	// Packed BCD compares like binary
+	freq_t low = pgm_read_dword(&bands[0].low);
+	freq_t high = pgm_read_dword(&bands[NUM_BANDS - 1].high);
+
+	if (freq < low)
+		freq = low;
+	else if (freq > high)
+		freq = high;
+
+	return freq;
+}
+
+
+//! \short Relay pattern of a band.
+inline uint8_t band_relay(int8_t band)
+{
+	return pgm_read_byte(&bands[band].relay);
+}
+
+
+//! \short Load the stacking registers with the defaults of the table.
+void band_init(void)
+{
+	for (int8_t i = 0; i < NUM_BANDS; ++i)
+	{
+		band_stack_t *stack = &band_stack[i];
+		stack->freq = pgm_read_dword(&bands[i].init);
+		stack->usb = pgm_read_byte(&bands[i].usb);
+		stack->step = pgm_read_byte(&bands[i].step);
+		stack->word = freq_vfo_word(stack->freq, stack->usb);
+	}
+}
+
+
+#endif // QROLLE_BAND_H
@@ -0,0 +1,147 @@
+#ifndef QROLLE_BCD_H
+#define QROLLE_BCD_H
+
+
+// Packed BCD arithmetic. AVR has no divide instruction, so numbers that are
+// mostly shown on the display or handled digit by digit are kept as eight
+// packed BCD digits, least significant digit in the lowest nibble.
+
+
+#include <inttypes.h>
+
+#include "prof.h"
+
+
+// Eight packed BCD digits
+typedef uint32_t bcd_t;
+
+// Largest representable number, also the nines' complement base
+#define BCD_MAX 0x99999999UL
+
+
+//! \short Add two packed BCD numbers.
+//! All digits are added in parallel: each digit is biased by 6 so that a
+//! decimal carry becomes a binary one, then the bias is removed from the
+//! digits that did not carry. The result wraps around modulo 10^8.
+bcd_t bcd_add(bcd_t a, bcd_t b)
+{
+	uint32_t t1 = a + 0x66666666UL;
+	uint32_t t2 = t1 + b;
+	uint32_t t3 = t1 ^ b;
+	uint32_t t4 = t2 ^ t3;
+	uint32_t t5 = ~t4 & 0x11111110UL;
+	uint32_t t6 = (t5 >> 2) | (t5 >> 3);
+
+	// The carry out of the top digit falls off the end
+	if (t2 >= t1)
+		t6 |= 0x60000000UL;
+
+	return t2 - t6;
+}
+
+
+//! \short Subtract two packed BCD numbers.
+//! Adds the tens' complement of b. The result wraps around modulo 10^8,
+//! which the caller can check beforehand with a < b.
+bcd_t bcd_sub(bcd_t a, bcd_t b)
+{
+	return bcd_add(bcd_add(a, BCD_MAX - b), 1);
+}
+
+
+//! \short Add two packed BCD numbers, saturating at BCD_MAX.
+bcd_t bcd_add_sat(bcd_t a, bcd_t b)
+{
+	bcd_t sum = bcd_add(a, b);
+
+	// A wrapped sum is always smaller than either operand
+	if (sum < a)
+		return BCD_MAX;
+	return sum;
+}
+
+
+//! \short Subtract two packed BCD numbers, saturating at zero.
+bcd_t bcd_sub_sat(bcd_t a, bcd_t b)
+{
+	if (a < b)
+		return 0;
+	return bcd_sub(a, b);
+}
+
+
+//! \short Convert a small binary number to packed BCD.
+//! Counts the tens and hundreds down instead of dividing.
+bcd_t bcd_from_u8(uint8_t num)
+{
+	bcd_t bcd = 0;
+
+	while (num >= 100)
+	{
+		num -= 100;
+		bcd += 0x100;
+	}
+	while (num >= 10)
+	{
+		num -= 10;
+		bcd += 0x10;
+	}
+
+	return bcd + num;
+}
+
+
+//! \short Multiply a power of ten by a small binary number.
+//! As pow10 is a single one digit followed by zeros, the product is num in
+//! BCD shifted left by the number of zeros. Saturates at BCD_MAX.
+//! \param pow10 1, 10, 100 etc. in packed BCD, or zero
+//! \param num the multiplier
+bcd_t bcd_mul_pow10(bcd_t pow10, uint8_t num)
+{
+	bcd_t bcd = bcd_from_u8(num);
+
+	if (!pow10)
+		return 0;
+
+	while (!(pow10 & 0x0F))
+	{
+		// The next shift would push digits off the top
+		if (bcd & 0xF0000000UL)
+			return BCD_MAX;
+		bcd <<= 4;
+		pow10 >>= 4;
+	}
+
+	return bcd;
+}
+
+
+//! \short Convert a packed BCD number to string representation.
+//! Works like int_to_str(): writes bufsize digits into a preallocated
+//! buffer, leading zeros padded with space. No terminating NUL.
+//! \param buf a pointer to the buffer the string is written to
+//! \param bufsize size of said buffer
+//! \param num the number to convert
+void bcd_to_str(char *buf, int8_t bufsize, bcd_t num)
+{
+	PROF_BEGIN(conv);
+
+	for (int8_t i = bufsize - 1; i >= 0; --i)
+	{
+		// leading zeros padded with space
+		if (num == 0)
+			buf[i] = ' ';
+		
+		// filled from the end
+		else
+			buf[i] = (num & 0x0F) + '0';
+		
+		// next digit
+		num >>= 4;
+	}
+
+	PROF_END(conv, PROF_BCD_TO_STR);
+}
+
+
+#endif // QROLLE_BCD_H
@@ -0,0 +1,38 @@
+#ifndef QROLLE_DDS_H
+#define QROLLE_DDS_H
+
+// DDS backend selection. The replacement boards are pin compatible, so the
+// wiring is common and the chip is chosen at compile time with one of
+// DDS_AD9835 (default), DDS_AD9833 or DDS_AD9834. There is no run-time
+// dispatch; the backend functions are called directly.
+//
+// Every backend provides:
+// - freqword_t and the constants DDS_WORD_BITS, DDS_WORD_MAX and
+//   DDS_REF_FREQ (reference clock, may be overridden on the command line)
+// - dds_init(freq): bring the chip up on the given frequency word
+// - dds_put_freq(freq): load frequency register 0
+// - dds_put_freqreg(reg, freq): load frequency register 0 or 1
+// - dds_put_phase(reg, phase): load a 12-bit phase register
+// - dds_select(freg, preg): choose the active frequency and phase registers
+// - dds_sleep(sleep): power the output down or up
+
+
+#include "hal.h"
+
+
+// Port and pins for the DDS chip
+#define AD_PORT     PORTB
+#define AD_PORT_DIR DDRB
+#define AD_SCLK     (1 << 2)
+#define AD_SDATA    (1 << 1)
+#define AD_FSYNC    (1 << 0)
+
+
+#if defined(DDS_AD9833) || defined(DDS_AD9834)
+#include "ad9833.h"
+#else
+#include "ad9835.h"
+#endif
+
+
+#endif // QROLLE_DDS_H
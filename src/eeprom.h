@@ -12,8 +12,7 @@
 // 2009-04-15 Initial version / AN
 
 
-#include <avr/io.h>
-#include <avr/eeprom.h>
+#include "hal.h"
 
 // Number of VFOs supported
 #define EEPROM_NVFO 2
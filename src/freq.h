@@ -11,78 +11,74 @@
 
 
 #include <inttypes.h>
-#include <avr/io.h>
 
-#include "freq.h"
-#include "ad9835.h"
+#include "hal.h"
+#include "dds.h"
+#include "bcd.h"
 #include "util.h"
+#include "prof.h"
 
 
-// Frequencies are represented as a signed number with
-// unity equal to one hertz
-typedef int32_t freq_t;
+// Frequencies are represented as eight packed BCD digits with unity equal
+// to one hertz, see bcd.h. Tuning and display then need no division.
+typedef bcd_t freq_t;
 
 
-// Band selection relay control pin. High == 20 metres, Low == 80 metres
-#define BAND_SEL_PORT PORTD
-#define BAND_SEL_PIN  (1 << 1)
+// Frequency word per hertz, from the word width and reference clock of
+// the DDS backend
+#define FREQ_COEF (DDS_WORD_MAX / DDS_REF_FREQ)
 
-// AD9835 reference XTAL frequency
-#define FREQ_XTAL_REF 50000000.0
+// Intermediate frequency, 5 MHz
+#define FREQ_IF 0x05000000UL
 
-// Intermediate frequency
-#define FREQ_IF 5000000
 
-// The lowest frequency at which the USB/20m filters are used
-#define FREQ_USB_LOW 10000000
+// Frequency word for one unit of each decimal digit
+const int32_t freq_coef_table[8] PROGMEM =
+{
+    FREQ_COEF,
+    FREQ_COEF * 10L,
+    FREQ_COEF * 100L,
+    FREQ_COEF * 1000L,
+    FREQ_COEF * 10000L,
+    FREQ_COEF * 100000L,
+    FREQ_COEF * 1000000L,
+    FREQ_COEF * 10000000L
+};
+
 
 //! \short Calculate correct frequency word
-//! Multiply the frequence to get the desired frequency word
+//! Sums the per-digit coefficients of the BCD frequency
 freqword_t freq_mul(freq_t freq)
 {
-    const double freq_coef = 0xFFFFFFFF / FREQ_XTAL_REF;
-    // const double freq_coef = 85.89934592
-    const int32_t coef_table[] = {
-        freq_coef,
-        freq_coef * 10L,
-        freq_coef * 100L,
-        freq_coef * 1000L,
-        freq_coef * 10000L,
-        freq_coef * 100000L,
-        freq_coef * 1000000L,
-        freq_coef * 10000000L
-    };
+    PROF_BEGIN(mul);
 
     freqword_t freqword = 0;
     for (unsigned char i = 0; i < 8; ++i)
     {
-        int digit = freq % 10;
-        freqword += digit * coef_table[i];
-        // freq = (freq - digit) / 10;
-		// int division
-		freq /= 10;
+        uint8_t digit = freq & 0x0F;
+        if (digit)
+            freqword += digit * (int32_t)pgm_read_dword(&freq_coef_table[i]);
+        freq >>= 4;
     }
     
-	// Debug.
-	// Print the raw frequency word on the screen.
-	/*
-	char bufasd[17] = {0};
-	int_to_str(bufasd, 15, freqword);
-	lcd_row2();
-	lcd_puts(bufasd);
-	*/
-	
+    PROF_END(mul, PROF_FREQ_MUL);
     return freqword;
 }
 
 
-//! \short Calculate required VFO frequency for given radio frequency
-inline freq_t freq_vfo(freq_t freq, int usb)
+//! \short Calculate the VFO frequency word for given radio frequency
+//! LSB reception needs f_vfo > f_if
+//! USB reception needs f_vfo < f_if
+freqword_t freq_vfo_word(freq_t freq, int8_t usb)
 {
-	if (usb)
-		return freq - FREQ_IF;
-	else
-		return freq + FREQ_IF;
+	if (!usb)
+		return freq_mul(bcd_add(freq, FREQ_IF));
+	if (freq >= FREQ_IF)
+		return freq_mul(bcd_sub(freq, FREQ_IF));
+
+	// The VFO frequency would be negative here. Program the negated word,
+	// like the old binary arithmetic did.
+	return -freq_mul(bcd_sub(FREQ_IF, freq));
 }
 
 
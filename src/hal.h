@@ -0,0 +1,38 @@
+#ifndef QROLLE_HAL_H
+#define QROLLE_HAL_H
+
+
+// Thin hardware abstraction layer.
+//
+// On target this is avr-libc and plain register access. When QROLLE_HOST is
+// defined the same names are provided by host/hal_host.h, which lets the
+// logic run natively against the behavioral models in host/.
+//
+// Constant tables and strings live in program memory through avr-libc's
+// PROGMEM, PSTR() and pgm_read_*(), which the host maps to plain memory.
+//
+// Output port writes go through hal_set(), hal_clr() and hal_write() so that
+// the host models see every pin transition. Everything else (PINx, ADCH and
+// friends) is read directly.
+
+
+#ifdef QROLLE_HOST
+
+#include "host/hal_host.h"
+
+#else // QROLLE_HOST
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+
+#define hal_set(reg, mask)  ((reg) |= (mask))
+#define hal_clr(reg, mask)  ((reg) &= ~(mask))
+#define hal_write(reg, val) ((reg) = (val))
+
+#endif // QROLLE_HOST
+
+
+#endif // QROLLE_HAL_H
@@ -0,0 +1,141 @@
+#ifndef QROLLE_AD9833_MODEL_H
+#define QROLLE_AD9833_MODEL_H
+
+
+// Behavioral model of the AD9833 / AD9834 serial interface. Decodes the
+// SCLK / SDATA / FSYNC pin stream into register state and reports the
+// output frequency. The AD9834 pin control (PIN/SW) is not modeled.
+
+
+#include <inttypes.h>
+
+#include "hal_host.h"
+
+
+typedef struct ad9833_model_s
+{
+	// Serial shift register
+	uint16_t shift;
+	uint8_t nbits;
+	uint8_t framing;
+
+	// Register state
+	uint32_t freg[2];
+	uint16_t preg[2];
+	uint16_t ctrl;
+	uint8_t lsb_done[2];  // B28 mode: LSB half written, MSB half next
+	uint16_t lsb[2];
+	uint8_t fselect;
+	uint8_t psel;
+	uint8_t sleep;
+	uint8_t reset;
+
+	// Statistics
+	uint32_t commands;      // complete 16-bit commands
+	uint32_t bad_frames;    // FSYNC raised after other than 16 bits
+	uint64_t last_fsync_ns; // virtual time of the last completed command
+} ad9833_model_t;
+
+
+ad9833_model_t ad9833_model;
+
+
+//! \short Execute a complete 16-bit command.
+void ad9833_model_cmd(ad9833_model_t *m, uint16_t cmd)
+{
+	switch (cmd >> 14)
+	{
+	// Control register
+	case 0:
+		m->ctrl = cmd;
+		m->fselect = (cmd >> 11) & 1;
+		m->psel = (cmd >> 10) & 1;
+		m->reset = (cmd >> 8) & 1;
+		m->sleep = (cmd & 0x00C0) != 0;
+		break;
+	// Frequency registers
+	case 1:
+	case 2:
+	{
+		uint8_t reg = (cmd >> 14) - 1;
+		uint32_t data = cmd & 0x3FFF;
+		if (m->ctrl & 0x2000)
+		{
+			// B28: LSB half is held until the MSB half arrives
+			if (!m->lsb_done[reg])
+			{
+				m->lsb[reg] = data;
+				m->lsb_done[reg] = 1;
+			}
+			else
+			{
+				m->freg[reg] = (data << 14) | m->lsb[reg];
+				m->lsb_done[reg] = 0;
+			}
+		}
+		else if (m->ctrl & 0x1000)
+			m->freg[reg] = (m->freg[reg] & 0x3FFF) | (data << 14);
+		else
+			m->freg[reg] = (m->freg[reg] & ~0x3FFFUL) | data;
+		break;
+	}
+	// Phase registers
+	case 3:
+		m->preg[(cmd >> 13) & 1] = cmd & 0x0FFF;
+		break;
+	}
+
+	++m->commands;
+	m->last_fsync_ns = hal_host_ns;
+}
+
+
+//! \short Feed a PORTB transition to the model.
+void ad9833_model_port(ad9833_model_t *m, uint8_t old, uint8_t val,
+                       uint8_t sclk, uint8_t sdata, uint8_t fsync)
+{
+	// FSYNC falling starts a frame
+	if ((old & fsync) && !(val & fsync))
+	{
+		m->framing = 1;
+		m->nbits = 0;
+		m->shift = 0;
+	}
+
+	// Data is clocked in on the falling edge of SCLK
+	if (m->framing && (old & sclk) && !(val & sclk))
+	{
+		m->shift = (m->shift << 1) | ((val & sdata) ? 1 : 0);
+		++m->nbits;
+	}
+
+	// FSYNC rising ends the frame
+	if (!(old & fsync) && (val & fsync) && m->framing)
+	{
+		m->framing = 0;
+		if (m->nbits == 16)
+			ad9833_model_cmd(m, m->shift);
+		else
+			++m->bad_frames;
+	}
+}
+
+
+//! \short Frequency word of the currently selected register.
+uint32_t ad9833_model_word(const ad9833_model_t *m)
+{
+	return m->freg[m->fselect];
+}
+
+
+//! \short Current output frequency in hertz, 0 when asleep.
+//! \param mclk reference clock in hertz
+double ad9833_model_freq(const ad9833_model_t *m, double mclk)
+{
+	if (m->sleep || m->reset)
+		return 0.0;
+	return ad9833_model_word(m) * (mclk / 268435456.0);
+}
+
+
+#endif // QROLLE_AD9833_MODEL_H
@@ -0,0 +1,158 @@
+#ifndef QROLLE_AD9835_MODEL_H
+#define QROLLE_AD9835_MODEL_H
+
+
+// Behavioral model of the AD9835 serial interface. Decodes the SCLK / SDATA /
+// FSYNC pin stream into register state and reports the output frequency.
+
+
+#include <inttypes.h>
+
+#include "hal_host.h"
+
+
+typedef struct ad9835_model_s
+{
+	// Serial shift register
+	uint16_t shift;
+	uint8_t nbits;
+	uint8_t framing;
+
+	// Register state
+	uint32_t freg[2];
+	uint16_t preg[4];
+	uint8_t defer;
+	uint8_t fselect;
+	uint8_t psel;
+	uint8_t selsrc;
+	uint8_t sync;
+	uint8_t sleep;
+	uint8_t reset;
+
+	// Statistics
+	uint32_t commands;     // complete 16-bit commands
+	uint32_t bad_frames;   // FSYNC raised after other than 16 bits
+	uint64_t last_fsync_ns; // virtual time of the last completed command
+} ad9835_model_t;
+
+
+ad9835_model_t ad9835_model;
+
+
+//! \short Execute a complete 16-bit command.
+void ad9835_model_cmd(ad9835_model_t *m, uint16_t cmd)
+{
+	uint8_t addr = (cmd >> 8) & 0x0F;
+	uint8_t data = cmd & 0xFF;
+
+	// SOURCE and CTRL carry their flags in D13..D12
+	switch (cmd & 0x8000 ? cmd >> 12 & 0xC : cmd >> 12)
+	{
+	// Phase registers are 12 bits wide, two addresses each, at A3 = 1.
+	// Anything else would hit a frequency register on the chip, so it is
+	// dropped here for the conformance check to notice.
+	case 0x0:
+		if (addr & 0x08)
+			m->preg[(addr >> 1) & 3] = ((data << 8) | m->defer) & 0x0FFF;
+		break;
+	case 0x1:
+	case 0x3:
+		m->defer = data;
+		break;
+	// Frequency registers are 32 bits, four addresses each. A 16-bit write
+	// stores the data byte and the deferred byte below it.
+	case 0x2:
+	{
+		// Frequency registers are at A3 = 0
+		if (addr & 0x08)
+			break;
+		uint8_t reg = (addr >> 2) & 1;
+		uint8_t shift = (addr & 3) * 8;
+		uint32_t mask = 0xFFFFUL << (shift - 8);
+		uint32_t val = ((uint32_t)data << shift) |
+		               ((uint32_t)m->defer << (shift - 8));
+		m->freg[reg] = (m->freg[reg] & ~mask) | val;
+		break;
+	}
+	// Register selection, effective when SELSRC is set
+	case 0x4:
+		m->psel = (cmd >> 9) & 3;
+		break;
+	case 0x5:
+		m->fselect = (cmd >> 11) & 1;
+		break;
+	case 0x6:
+		m->psel = (cmd >> 9) & 3;
+		m->fselect = (cmd >> 11) & 1;
+		break;
+	case 0x8:
+		m->sync = (cmd >> 13) & 1;
+		m->selsrc = (cmd >> 12) & 1;
+		break;
+	case 0xC:
+		m->sleep = (cmd >> 13) & 1;
+		m->reset = (cmd >> 12) & 1;
+		if (cmd & 0x0800)
+		{
+			m->sync = 0;
+			m->selsrc = 0;
+		}
+		break;
+	default:
+		break;
+	}
+
+	++m->commands;
+	m->last_fsync_ns = hal_host_ns;
+}
+
+
+//! \short Feed a PORTB transition to the model.
+void ad9835_model_port(ad9835_model_t *m, uint8_t old, uint8_t val,
+                       uint8_t sclk, uint8_t sdata, uint8_t fsync)
+{
+	// FSYNC falling starts a frame
+	if ((old & fsync) && !(val & fsync))
+	{
+		m->framing = 1;
+		m->nbits = 0;
+		m->shift = 0;
+	}
+
+	// Data is clocked in on the falling edge of SCLK
+	if (m->framing && (old & sclk) && !(val & sclk))
+	{
+		m->shift = (m->shift << 1) | ((val & sdata) ? 1 : 0);
+		++m->nbits;
+	}
+
+	// FSYNC rising ends the frame
+	if (!(old & fsync) && (val & fsync) && m->framing)
+	{
+		m->framing = 0;
+		if (m->nbits == 16)
+			ad9835_model_cmd(m, m->shift);
+		else
+			++m->bad_frames;
+	}
+}
+
+
+//! \short Frequency word of the currently selected register.
+uint32_t ad9835_model_word(const ad9835_model_t *m)
+{
+	return m->freg[m->selsrc ? m->fselect : 0];
+}
+
+
+//! \short Current output frequency in hertz, 0 when asleep.
+//! \param mclk reference clock in hertz
+double ad9835_model_freq(const ad9835_model_t *m, double mclk)
+{
+	if (m->sleep || m->reset)
+		return 0.0;
+	return ad9835_model_word(m) * (mclk / 4294967296.0);
+}
+
+
+#endif // QROLLE_AD9835_MODEL_H
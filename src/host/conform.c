@@ -0,0 +1,112 @@
+// DDS backend conformance check.
+//
+// Drives the dds.h interface of the backend selected at compile time and
+// compares the register state decoded by the serial-stream model with what
+// was asked for. Build once per backend, see "make conform".
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../radio.h"
+#include "dds_model.h"
+
+
+static int failures;
+
+
+static void check(int ok, const char *what)
+{
+	printf("%s %s\n", ok ? "pass" : "FAIL", what);
+	if (!ok)
+		++failures;
+}
+
+
+static void conform_on_write(volatile uint8_t *reg, uint8_t old, uint8_t val)
+{
+	if (reg == &AD_PORT)
+		dds_model_port(old, val);
+}
+
+
+//! \short Tune the radio and compare the DDS output with the VFO frequency.
+static void check_tune(freq_t freq, int8_t usb, double expect)
+{
+	char what[64];
+	radio_setfreq(freq, usb);
+	double out = dds_model_freq();
+
+	// Truncated coefficients are off by less than a hertz
+	snprintf(what, sizeof(what), "tune %08lX %s: %.2f Hz, expected %.0f Hz",
+	         (unsigned long)freq, usb ? "USB" : "LSB", out, expect);
+	check(out > expect - 2.0 && out < expect + 2.0, what);
+}
+
+
+int main(void)
+{
+	static const freqword_t words[] =
+	{
+		0, 1, 0x3FFF, 0x4000, 0x0ABCDEF1, 0x12345678, DDS_WORD_MAX,
+		0xFFFFFFFF
+	};
+
+	hal_host_on_write = conform_on_write;
+	hal_write(AD_PORT, AD_SCLK | AD_FSYNC);
+	sei();
+
+	printf("DDS backend: %s, %d-bit word, %.0f Hz reference\n",
+	       DDS_MODEL_NAME, DDS_WORD_BITS, DDS_REF_FREQ);
+
+	dds_init(0x01234567 & DDS_WORD_MAX);
+	check(dds_model.freg[0] == (0x01234567 & DDS_WORD_MAX),
+	      "init loads FREG0");
+	check(!dds_model.sleep && dds_model.fselect == 0 && dds_model.psel == 0,
+	      "init leaves the chip running on FREG0 / PHASE0");
+	check(dds_model_word() == (0x01234567 & DDS_WORD_MAX),
+	      "init output word");
+
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+	{
+		char what[64];
+		dds_put_freq(words[i]);
+		snprintf(what, sizeof(what), "put_freq %08lX", (unsigned long)words[i]);
+		check(dds_model.freg[0] == (words[i] & DDS_WORD_MAX), what);
+	}
+
+	dds_put_freq(0x00112233);
+	dds_put_freqreg(1, 0x00445566);
+	check(dds_model.freg[1] == 0x00445566 && dds_model.freg[0] == 0x00112233,
+	      "put_freqreg 1 leaves FREG0 alone");
+
+	dds_select(1, 1);
+	check(dds_model_word() == 0x00445566 && dds_model.psel == 1,
+	      "select FREG1 / PHASE1");
+	dds_select(0, 0);
+	check(dds_model_word() == 0x00112233 && dds_model.psel == 0,
+	      "select FREG0 / PHASE0");
+
+	dds_put_phase(1, 0x0ABC);
+	check(dds_model.preg[1] == 0x0ABC, "put_phase 1");
+	dds_put_phase(0, 0x0123);
+	check(dds_model.preg[0] == 0x0123 && dds_model.preg[1] == 0x0ABC,
+	      "put_phase 0 leaves PHASE1 alone");
+
+	dds_sleep(1);
+	check(dds_model_freq() == 0.0, "sleep stops the output");
+	dds_sleep(0);
+	check(dds_model_freq() > 0.0 && dds_model_word() == 0x00112233,
+	      "wake resumes on the same register");
+
+	// Whole tuning pipeline, VFO = RX + IF for LSB, RX - IF for USB
+	check_tune(0x03699000UL, 0, 8699000.0);
+	check_tune(0x07100000UL, 0, 12100000.0);
+	check_tune(0x14267000UL, 1, 9267000.0);
+	check_tune(0x10000010UL, 1, 5000010.0);
+
+	check(dds_model.bad_frames == 0, "every frame is 16 bits");
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,38 @@
+#ifndef QROLLE_DDS_MODEL_H
+#define QROLLE_DDS_MODEL_H
+
+
+// Picks the model that matches the DDS backend chosen in dds.h. Both models
+// have the same register and statistics fields for frequency registers 0
+// and 1, phase registers 0 and 1, fselect, psel and sleep.
+
+
+#include "../dds.h"
+
+
+#if defined(DDS_AD9833) || defined(DDS_AD9834)
+
+#include "ad9833_model.h"
+
+#define DDS_MODEL_NAME "AD9833/AD9834"
+#define dds_model ad9833_model
+#define dds_model_port(old, val) \
+	ad9833_model_port(&ad9833_model, old, val, AD_SCLK, AD_SDATA, AD_FSYNC)
+#define dds_model_word() ad9833_model_word(&ad9833_model)
+#define dds_model_freq() ad9833_model_freq(&ad9833_model, DDS_REF_FREQ)
+
+#else
+
+#include "ad9835_model.h"
+
+#define DDS_MODEL_NAME "AD9835"
+#define dds_model ad9835_model
+#define dds_model_port(old, val) \
+	ad9835_model_port(&ad9835_model, old, val, AD_SCLK, AD_SDATA, AD_FSYNC)
+#define dds_model_word() ad9835_model_word(&ad9835_model)
+#define dds_model_freq() ad9835_model_freq(&ad9835_model, DDS_REF_FREQ)
+
+#endif
+
+
+#endif // QROLLE_DDS_MODEL_H
@@ -0,0 +1,128 @@
+#ifndef QROLLE_HAL_HOST_H
+#define QROLLE_HAL_HOST_H
+
+
+// Host side implementation of hal.h. Registers are plain variables, delays
+// advance a virtual clock and EEPROM lives in RAM. Models hook into port
+// writes and clock advances through hal_host_on_write and hal_host_on_time.
+
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+
+// I/O registers used by the firmware
+volatile uint8_t PORTB, PORTC, PORTD;
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t PINB, PINC, PIND;
+volatile uint8_t ADCH, ADCL, ADMUX, ADCSRA;
+volatile uint8_t MCUCR, GIMSK, TIMSK, TIFR;
+volatile uint8_t SREG;
+
+// Bit positions, as in the ATmega8 datasheet
+#define MUX0  0
+#define MUX1  1
+#define MUX2  2
+#define MUX3  3
+#define ADLAR 5
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIF  4
+#define ADFR  5
+#define ADSC  6
+#define ADEN  7
+#define ISC00 0
+#define ISC01 1
+#define INT0  6
+
+// Global interrupt enable flag in SREG
+#define HAL_HOST_SREG_I 0x80
+
+
+#define cli() ((void)(SREG &= ~HAL_HOST_SREG_I))
+#define sei() ((void)(SREG |= HAL_HOST_SREG_I))
+
+// Interrupt handlers become ordinary functions that the models call
+#define ISR(vector) void vector(void)
+
+
+// Virtual time in nanoseconds since reset
+uint64_t hal_host_ns;
+
+// Called after every change of a port, with the old and new value
+void (*hal_host_on_write)(volatile uint8_t *reg, uint8_t old, uint8_t val);
+
+// Called after every advance of the virtual clock
+void (*hal_host_on_time)(void);
+
+
+//! \short Virtual time converted to CPU cycles.
+static inline uint64_t hal_host_cycles(void)
+{
+	return hal_host_ns * (F_CPU / 1000000UL) / 1000;
+}
+
+
+//! \short Advance the virtual clock.
+void hal_host_advance(uint64_t ns)
+{
+	hal_host_ns += ns;
+	if (hal_host_on_time)
+		hal_host_on_time();
+}
+
+
+//! \short Interrupts enabled?
+static inline int hal_host_int_enabled(void)
+{
+	return (SREG & HAL_HOST_SREG_I) != 0;
+}
+
+
+//! \short Write an output port and notify the models.
+static inline void hal_host_write(volatile uint8_t *reg, uint8_t val)
+{
+	uint8_t old = *reg;
+	*reg = val;
+	if (hal_host_on_write)
+		hal_host_on_write(reg, old, val);
+}
+
+
+#define hal_set(reg, mask)  hal_host_write(&(reg), (reg) | (mask))
+#define hal_clr(reg, mask)  hal_host_write(&(reg), (reg) & ~(mask))
+#define hal_write(reg, val) hal_host_write(&(reg), (val))
+
+
+// util/delay.h
+#define _delay_us(us) hal_host_advance((uint64_t)((us) * 1000.0))
+#define _delay_ms(ms) hal_host_advance((uint64_t)((ms) * 1000000.0))
+
+
+// avr/pgmspace.h. Flash is ordinary memory here.
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+
+
+// avr/eeprom.h. EEMEM variables are ordinary RAM that stands in for the
+// EEPROM contents.
+#define EEMEM
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+// Writes take the datasheet 8.5 ms per byte
+static inline void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+	memcpy(dst, src, n);
+	hal_host_advance(n * 8500000ULL);
+}
+
+
+#endif // QROLLE_HAL_HOST_H
@@ -0,0 +1,184 @@
+#ifndef QROLLE_HD44780_MODEL_H
+#define QROLLE_HD44780_MODEL_H
+
+
+// Behavioral model of a 16x2 HD44780 display on a 4-bit bus. Decodes the
+// nibbles latched on the falling edge of EN, keeps DDRAM and CGRAM and
+// renders the display as text. Writes made while the controller is still
+// busy with the previous instruction are counted as timing violations.
+
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "hal_host.h"
+
+
+#define HD44780_MODEL_COLS 16
+#define HD44780_MODEL_ROWS 2
+
+// Execution times from the datasheet at the slowest oscillator, 190 kHz,
+// in nanoseconds
+#define HD44780_MODEL_POWERON_NS 15000000ULL
+#define HD44780_MODEL_EXEC_NS    52600ULL
+#define HD44780_MODEL_CLEAR_NS   2160000ULL
+
+
+typedef struct hd44780_model_s
+{
+	uint8_t ddram[0x80];
+	uint8_t cgram[0x40];
+	uint8_t addr;
+	uint8_t cgram_mode;   // last address set was a CGRAM address
+	uint8_t four_bit;     // interface switched to 4 bits
+	uint8_t init_writes;  // 8-bit writes seen, for the init timing
+	uint8_t high;         // high nibble of the current byte
+	uint8_t have_high;    // waiting for the low nibble
+	uint8_t display_on;
+
+	uint64_t busy_until_ns;
+
+	// Statistics
+	uint32_t data_writes;
+	uint32_t instructions;
+	uint32_t violations;
+	uint64_t last_write_ns; // virtual time of the last completed byte
+} hd44780_model_t;
+
+
+hd44780_model_t hd44780_model;
+
+
+//! \short Reset the model to its power-on state.
+void hd44780_model_reset(hd44780_model_t *m)
+{
+	memset(m, 0, sizeof(*m));
+	memset(m->ddram, ' ', sizeof(m->ddram));
+	m->busy_until_ns = hal_host_ns + HD44780_MODEL_POWERON_NS;
+}
+
+
+//! \short Execute an instruction (RS low).
+void hd44780_model_instruction(hd44780_model_t *m, uint8_t byte)
+{
+	uint64_t exec = HD44780_MODEL_EXEC_NS;
+
+	if (byte & 0x80)
+	{
+		m->addr = byte & 0x7F;
+		m->cgram_mode = 0;
+	}
+	else if (byte & 0x40)
+	{
+		m->addr = byte & 0x3F;
+		m->cgram_mode = 1;
+	}
+	else if (byte & 0x20)
+	{
+		// Function set, DL bit selects the interface width
+		m->four_bit = !(byte & 0x10);
+	}
+	else if (byte & 0x08)
+	{
+		m->display_on = (byte & 0x04) != 0;
+	}
+	else if (byte & 0x02)
+	{
+		m->addr = 0;
+		m->cgram_mode = 0;
+		exec = HD44780_MODEL_CLEAR_NS;
+	}
+	else if (byte & 0x01)
+	{
+		memset(m->ddram, ' ', sizeof(m->ddram));
+		m->addr = 0;
+		m->cgram_mode = 0;
+		exec = HD44780_MODEL_CLEAR_NS;
+	}
+
+	++m->instructions;
+	m->busy_until_ns = hal_host_ns + exec;
+}
+
+
+//! \short Write a data byte (RS high) to DDRAM or CGRAM.
+void hd44780_model_data(hd44780_model_t *m, uint8_t byte)
+{
+	if (m->cgram_mode)
+	{
+		m->cgram[m->addr & 0x3F] = byte & 0x1F;
+		m->addr = (m->addr + 1) & 0x3F;
+	}
+	else
+	{
+		m->ddram[m->addr & 0x7F] = byte;
+		m->addr = (m->addr + 1) & 0x7F;
+	}
+
+	++m->data_writes;
+	m->busy_until_ns = hal_host_ns + HD44780_MODEL_EXEC_NS;
+}
+
+
+//! \short Latch a nibble, i.e. feed a falling edge of EN to the model.
+//! \param rs state of the RS pin
+//! \param nibble the four data lines D7..D4 as the low nibble
+void hd44780_model_latch(hd44780_model_t *m, uint8_t rs, uint8_t nibble)
+{
+	if (hal_host_ns < m->busy_until_ns)
+		++m->violations;
+
+	// Before the switch to 4 bits only the upper data lines are connected
+	// and every write is a whole instruction
+	if (!m->four_bit)
+	{
+		// The first function set after power-on takes 4.1 ms and the
+		// second one 100 us
+		hd44780_model_instruction(m, nibble << 4);
+		if (m->init_writes == 0)
+			m->busy_until_ns = hal_host_ns + 4100000ULL;
+		else if (m->init_writes == 1)
+			m->busy_until_ns = hal_host_ns + 100000ULL;
+		++m->init_writes;
+		return;
+	}
+
+	if (!m->have_high)
+	{
+		m->high = nibble << 4;
+		m->have_high = 1;
+		return;
+	}
+
+	m->have_high = 0;
+	if (rs)
+		hd44780_model_data(m, m->high | nibble);
+	else
+		hd44780_model_instruction(m, m->high | nibble);
+	m->last_write_ns = hal_host_ns;
+}
+
+
+//! \short Render the display contents as text.
+//! Custom characters 0-7 are rendered as the digits '0'-'7'.
+//! \param rows buffer for two NUL-terminated rows
+void hd44780_model_render(const hd44780_model_t *m,
+                          char rows[HD44780_MODEL_ROWS][HD44780_MODEL_COLS + 1])
+{
+	for (uint8_t row = 0; row < HD44780_MODEL_ROWS; ++row)
+	{
+		for (uint8_t col = 0; col < HD44780_MODEL_COLS; ++col)
+		{
+			uint8_t c = m->ddram[row * 0x40 + col];
+			if (c < 8)
+				c = '0' + c;
+			else if (c < 0x20 || c > 0x7E)
+				c = '?';
+			rows[row][col] = c;
+		}
+		rows[row][HD44780_MODEL_COLS] = '\0';
+	}
+}
+
+
+#endif // QROLLE_HD44780_MODEL_H
@@ -0,0 +1,156 @@
+#ifndef QROLLE_INJECT_H
+#define QROLLE_INJECT_H
+
+
+// Scripted input injector for the host build. Encoder detents, button
+// presses and ADC readings are queued with a virtual timestamp and applied
+// to the pins when the virtual clock reaches them. Encoder edges raise INT0
+// like the real hardware, or are held pending while interrupts are disabled.
+
+
+#include <inttypes.h>
+
+#include "hal_host.h"
+
+
+// Maximum number of queued events
+#define INJECT_QUEUE 256
+
+
+typedef enum inject_type_e
+{
+	INJECT_CW,          // one detent clockwise
+	INJECT_CCW,         // one detent counterclockwise
+	INJECT_BUTTON_DOWN,
+	INJECT_BUTTON_UP,
+	INJECT_ADC          // new ADC reading in value
+} inject_type_t;
+
+
+typedef struct inject_event_s
+{
+	uint64_t at_ns;
+	uint8_t type;
+	uint8_t value;
+} inject_event_t;
+
+
+typedef struct inject_s
+{
+	// Ring buffer of events ordered by time
+	inject_event_t queue[INJECT_QUEUE];
+	uint16_t head;
+	uint16_t count;
+
+	// Encoder edges waiting for interrupts to be enabled
+	int8_t pending;
+
+	// Pins driven by the injector
+	uint8_t pin_cw;
+	uint8_t pin_ccw;
+	uint8_t pin_button;
+
+	// Interrupt handler for the encoder
+	void (*isr)(void);
+
+	// Statistics
+	uint32_t edges;
+	uint64_t last_edge_ns; // virtual time of the last delivered edge
+} inject_t;
+
+
+inject_t inject;
+
+
+//! \short Queue an event. Events must be queued in time order.
+//! \return 0 on success, -1 if the queue is full
+int inject_at(inject_t *in, uint64_t at_ns, uint8_t type, uint8_t value)
+{
+	if (in->count >= INJECT_QUEUE)
+		return -1;
+
+	inject_event_t *ev = &in->queue[(in->head + in->count) % INJECT_QUEUE];
+	ev->at_ns = at_ns;
+	ev->type = type;
+	ev->value = value;
+	++in->count;
+	return 0;
+}
+
+
+//! \short Deliver one encoder edge through the interrupt handler.
+static void inject_edge(inject_t *in, int8_t dir)
+{
+	// The handler samples the CCW pin on the rising CW edge
+	if (dir > 0)
+		PIND |= in->pin_ccw;
+	else
+		PIND &= ~in->pin_ccw;
+	PIND |= in->pin_cw;
+	in->isr();
+	PIND &= ~in->pin_cw;
+
+	++in->edges;
+	in->last_edge_ns = hal_host_ns;
+}
+
+
+//! \short Apply every event that is due. Call whenever time advances.
+void inject_poll(inject_t *in)
+{
+	// Deliver edges held back by a cli()
+	while (in->pending && hal_host_int_enabled())
+	{
+		int8_t dir = in->pending > 0 ? 1 : -1;
+		in->pending -= dir;
+		inject_edge(in, dir);
+	}
+
+	while (in->count && in->queue[in->head].at_ns <= hal_host_ns)
+	{
+		inject_event_t *ev = &in->queue[in->head];
+		in->head = (in->head + 1) % INJECT_QUEUE;
+		--in->count;
+
+		switch (ev->type)
+		{
+		case INJECT_CW:
+		case INJECT_CCW:
+		{
+			int8_t dir = ev->type == INJECT_CW ? 1 : -1;
+			if (hal_host_int_enabled())
+				inject_edge(in, dir);
+			else
+				in->pending += dir;
+			break;
+		}
+		case INJECT_BUTTON_DOWN:
+			PIND &= ~in->pin_button;
+			break;
+		case INJECT_BUTTON_UP:
+			PIND |= in->pin_button;
+			break;
+		case INJECT_ADC:
+			ADCH = ev->value;
+			break;
+		}
+	}
+}
+
+
+//! \short Set up the injector with idle pins.
+void inject_init(inject_t *in, uint8_t pin_cw, uint8_t pin_ccw,
+                 uint8_t pin_button, void (*isr)(void))
+{
+	memset(in, 0, sizeof(*in));
+	in->pin_cw = pin_cw;
+	in->pin_ccw = pin_ccw;
+	in->pin_button = pin_button;
+	in->isr = isr;
+
+	// Pull-ups: button released
+	PIND |= pin_button;
+}
+
+
+#endif // QROLLE_INJECT_H
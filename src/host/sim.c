@@ -0,0 +1,415 @@
+// Native host simulator for the QROlle DDS firmware.
+//
+// Runs the unmodified UI logic against the DDS, HD44780 and input models
+// and reports boot, latency and throughput figures. Times marked "virtual"
+// come from the modeled delays, i.e. what the target would spend waiting;
+// "host" figures are wall clock on the build machine.
+
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../ui.h"
+#include "dds_model.h"
+#include "hd44780_model.h"
+#include "inject.h"
+
+
+// Modeled cost of one idle ui_poll() round
+#define SIM_POLL_NS 20000ULL
+
+// Number of detents delivered at once for the burst run
+#define SIM_BURST 12
+
+// Number of detents for the throughput run
+#define SIM_DETENTS 20000
+
+// Longest acceptable traced latency. A watch hop across bands, a frame
+// wait and a busy redraw together stay well below this.
+#define SIM_TRACE_MAX_MS 100
+
+// S-meter readings with and without the watched station
+#define SIM_STRONG 200
+#define SIM_QUIET 20
+
+
+static int failures;
+
+// DDS output frequency that hears a strong station, 0 for none
+static double sim_signal_hz;
+
+// Band relay port writes, and the ones that switched the relay
+static unsigned sim_relay_writes;
+static unsigned sim_relay_switches;
+
+
+//! \short Route port writes to the models.
+static void sim_on_write(volatile uint8_t *reg, uint8_t old, uint8_t val)
+{
+	if (reg == &AD_PORT)
+	{
+		dds_model_port(old, val);
+
+		// A station heard only with the DDS on sim_signal_hz
+		if (sim_signal_hz > 0.0)
+		{
+			double off = dds_model_freq() - sim_signal_hz;
+			ADCH = off > -100.0 && off < 100.0 ? SIM_STRONG : SIM_QUIET;
+		}
+	}
+
+	if (reg == &BAND_SEL_PORT)
+	{
+		++sim_relay_writes;
+		if ((old ^ val) & BAND_SEL_PINS)
+			++sim_relay_switches;
+	}
+
+	if (reg == &LCD_CTRL_PORT && (old & LCD_EN) && !(val & LCD_EN))
+	{
+		uint8_t nibble = 0;
+		if (val & LCD_DATA7)
+			nibble |= 8;
+		if (val & LCD_DATA6)
+			nibble |= 4;
+		if (val & LCD_DATA5)
+			nibble |= 2;
+		if (val & LCD_DATA4)
+			nibble |= 1;
+		hd44780_model_latch(&hd44780_model, (val & LCD_RS) != 0, nibble);
+	}
+}
+
+
+static void sim_on_time(void)
+{
+	inject_poll(&inject);
+}
+
+
+static double sim_host_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+//! \short Poll the UI until the virtual clock reaches the given time.
+static void sim_run_until(ui_t *ui, ui_loop_t *loop, uint64_t until_ns)
+{
+	while (hal_host_ns < until_ns)
+	{
+		ui_poll(ui, loop);
+		hal_host_advance(SIM_POLL_NS);
+	}
+}
+
+
+//! \short Hold the button and turn by the given number of steps.
+static void sim_steps(ui_t *ui, ui_loop_t *loop, int steps)
+{
+	uint64_t t = hal_host_ns + 1000000ULL;
+	uint8_t type = steps < 0 ? INJECT_CCW : INJECT_CW;
+	int detents = (steps < 0 ? -steps : steps) * SLOW_TRESHOLD;
+
+	inject_at(&inject, t, INJECT_BUTTON_DOWN, 0);
+	for (int i = 0; i < detents; ++i)
+		inject_at(&inject, t += 20000000ULL, type, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_BUTTON_UP, 0);
+	sim_run_until(ui, loop, t + 50000000ULL);
+}
+
+
+//! \short Convert packed BCD to binary.
+static long sim_bcd_to_long(bcd_t bcd)
+{
+	long val = 0;
+	for (int i = 7; i >= 0; --i)
+		val = val * 10 + ((bcd >> (4 * i)) & 0x0F);
+	return val;
+}
+
+
+//! \short Expected DDS output for a VFO.
+static double sim_vfo_hz(const ui_t *ui, int vfo)
+{
+	long hz = sim_bcd_to_long(ui->freq[vfo]);
+	return ui->usb[vfo] ? hz - 5000000.0 : hz + 5000000.0;
+}
+
+
+//! \short Check that the DDS and the display agree with the UI state.
+static void sim_check(const char *what, const ui_t *ui)
+{
+	char rows[HD44780_MODEL_ROWS][HD44780_MODEL_COLS + 1];
+	char expect[11];
+	char buf[24];
+	freq_t freq = ui->freq[ui->vfo];
+	double vfo = sim_vfo_hz(ui, ui->vfo);
+	long hz = sim_bcd_to_long(freq);
+	double out = dds_model_freq();
+
+	hd44780_model_render(&hd44780_model, rows);
+
+	// Same layout as ui_freqline()
+	snprintf(buf, sizeof(buf), "%7ld", hz / 10);
+	for (int i = 0, j = 0; i < 7; ++i)
+	{
+		expect[j++] = buf[i];
+		if (i == 1 || i == 4)
+			expect[j++] = '.';
+		expect[j] = '\0';
+	}
+
+	printf("%-10s |%s| |%s| DDS %.1f Hz\n", what, rows[0], rows[1], out);
+
+	if (out < vfo - 20.0 || out > vfo + 20.0)
+	{
+		printf("FAIL: DDS at %.1f Hz, expected %.1f Hz\n", out, vfo);
+		++failures;
+	}
+	if (strncmp(rows[0], expect, 9) != 0)
+	{
+		printf("FAIL: display shows \"%.9s\", expected \"%s\"\n",
+		       rows[0], expect);
+		++failures;
+	}
+}
+
+
+int main(void)
+{
+	ui_t ui;
+	ui_loop_t loop;
+
+	hal_host_on_write = sim_on_write;
+	hal_host_on_time = sim_on_time;
+	hd44780_model_reset(&hd44780_model);
+	inject_init(&inject, ENCODER_CW, ENCODER_CCW, BUTTON_PIN, INT0_vect);
+
+	printf("DDS backend: %s\n", DDS_MODEL_NAME);
+
+	// Boot
+	hal_write(AD_PORT, AD_SCLK | AD_FSYNC);
+	interrupt_init();
+	ui_new(&ui);
+	ui_start(&ui, &loop);
+	printf("boot: RF up at %.3f ms, first frame at %.3f ms (virtual)\n",
+	       dds_model.last_fsync_ns / 1e6,
+	       hd44780_model.last_write_ns / 1e6);
+	sim_check("boot", &ui);
+
+	// A few detents up, then down past the start
+	uint64_t t = hal_host_ns + 1000000ULL;
+	for (int i = 0; i < 5; ++i)
+		inject_at(&inject, t += 50000000ULL, INJECT_CW, 0);
+	for (int i = 0; i < 8; ++i)
+		inject_at(&inject, t += 50000000ULL, INJECT_CCW, 0);
+	sim_run_until(&ui, &loop, t + 50000000ULL);
+	sim_check("tune", &ui);
+
+	// Short press switches the VFO
+	inject_at(&inject, t += 100000000ULL, INJECT_BUTTON_DOWN, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_BUTTON_UP, 0);
+	sim_run_until(&ui, &loop, t + 200000000ULL);
+	sim_check("vfo", &ui);
+
+	// Latency of a single detent
+	uint32_t commands_start = dds_model.commands;
+	t = hal_host_ns + 1000000ULL;
+	inject_at(&inject, t, INJECT_CW, 0);
+	sim_run_until(&ui, &loop, t + 100000000ULL);
+	uint32_t upload = dds_model.commands - commands_start;
+	printf("latency: encoder to RF %.3f ms, encoder to pixel %.3f ms "
+	       "(virtual)\n",
+	       (dds_model.last_fsync_ns - inject.last_edge_ns) / 1e6,
+	       (hd44780_model.last_write_ns - inject.last_edge_ns) / 1e6);
+	sim_check("latency", &ui);
+
+	// A burst of detents arriving while the loop is busy is applied as a
+	// single retune of the whole distance
+	freq_t burst_start = ui.freq[ui.vfo];
+	freq_t burst_step = pgm_read_dword(&steps[ui.step[ui.vfo]].step);
+	commands_start = dds_model.commands;
+	t = hal_host_ns + 1000000ULL;
+	for (int i = 0; i < SIM_BURST; ++i)
+		inject_at(&inject, t, INJECT_CW, 0);
+	sim_run_until(&ui, &loop, t + 100000000ULL);
+	printf("burst: %d detents, %u DDS commands\n", SIM_BURST,
+	       dds_model.commands - commands_start);
+	if (sim_bcd_to_long(ui.freq[ui.vfo]) != sim_bcd_to_long(burst_start) +
+	    SIM_BURST * sim_bcd_to_long(burst_step))
+	{
+		printf("FAIL: burst did not move %d steps\n", SIM_BURST);
+		++failures;
+	}
+	if (dds_model.commands - commands_start != upload)
+	{
+		printf("FAIL: burst took more than one DDS upload\n");
+		++failures;
+	}
+	sim_check("burst", &ui);
+
+	// Throughput: one detent at a time, as fast as the loop takes them
+	uint64_t virt_start = hal_host_ns;
+	uint32_t edges_start = inject.edges;
+	double host_start = sim_host_seconds();
+	for (int i = 0; i < SIM_DETENTS; ++i)
+	{
+		inject_at(&inject, hal_host_ns, i & 1 ? INJECT_CCW : INJECT_CW, 0);
+		inject_poll(&inject);
+		do
+		{
+			ui_poll(&ui, &loop);
+		}
+		while (loop.rotation || encoder_dir);
+	}
+	double host_secs = sim_host_seconds() - host_start;
+	double virt_secs = (hal_host_ns - virt_start) / 1e9;
+	sim_run_until(&ui, &loop, hal_host_ns + 100000000ULL);
+	uint32_t edges = inject.edges - edges_start;
+	printf("throughput: %u detents, %.0f detents/s host, "
+	       "%.1f detents/s virtual\n",
+	       edges, edges / host_secs, edges / virt_secs);
+	sim_check("spin", &ui);
+	printf("display: %u frames drawn, %u line updates dropped\n",
+	       loop.frames, loop.dropped);
+
+	// Dual watch: a station comes up on VFO A while listening to VFO B.
+	// Hold the button and turn back past the band and scan steps to the
+	// watch step, then one detent for WATCH_ON and another for WATCH_AUTO.
+	sim_signal_hz = sim_vfo_hz(&ui, 0);
+	ADCH = SIM_QUIET;
+	t = hal_host_ns + 1000000ULL;
+	inject_at(&inject, t, INJECT_BUTTON_DOWN, 0);
+	for (int i = 0; i < 5 * SLOW_TRESHOLD; ++i)
+		inject_at(&inject, t += 20000000ULL, INJECT_CCW, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_BUTTON_UP, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_CW, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_CW, 0);
+	sim_run_until(&ui, &loop, t + 3000000000ULL);
+	printf("watch: gap %.3f ms, longest %.3f ms (virtual)\n",
+	       loop.watch_gap * TICK_FINE_US / 1e3,
+	       loop.watch_gap_max * TICK_FINE_US / 1e3);
+	if (loop.watch != WATCH_AUTO || ui.vfo != 0)
+	{
+		printf("FAIL: dual watch did not switch over to VFO A\n");
+		++failures;
+	}
+	sim_check("watch", &ui);
+
+	// Scanner: up from VFO A towards VFO B, stopping on a station 37 kHz
+	// up and moving on once it has gone quiet. VFO A is on 100 Hz steps,
+	// the scan step is four back from there.
+	freq_t station = bcd_add(ui.freq[0], 0x37000UL);
+	sim_signal_hz = sim_bcd_to_long(station) + 5000000.0;
+	t = hal_host_ns + 1000000ULL;
+	inject_at(&inject, t, INJECT_BUTTON_DOWN, 0);
+	for (int i = 0; i < 4 * SLOW_TRESHOLD; ++i)
+		inject_at(&inject, t += 20000000ULL, INJECT_CCW, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_BUTTON_UP, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_CW, 0);
+	sim_run_until(&ui, &loop, t + 1000000000ULL);
+	sim_check("scan stop", &ui);
+	if (loop.scan != SCAN_BUSY || ui.freq[0] != station)
+	{
+		printf("FAIL: scanner did not stop on the station\n");
+		++failures;
+	}
+	sim_signal_hz = 0.0;
+	ADCH = SIM_QUIET;
+	sim_run_until(&ui, &loop, hal_host_ns + 4000000000ULL);
+	printf("scan: %lx channels/s (virtual)\n", (unsigned long)loop.scan_rate);
+	if (loop.scan == SCAN_OFF || loop.scan == SCAN_BUSY)
+	{
+		printf("FAIL: scanner did not resume\n");
+		++failures;
+	}
+	t = hal_host_ns + 1000000ULL;
+	inject_at(&inject, t, INJECT_BUTTON_DOWN, 0);
+	inject_at(&inject, t += 50000000ULL, INJECT_BUTTON_UP, 0);
+	sim_run_until(&ui, &loop, t + 200000000ULL);
+	sim_check("scan off", &ui);
+
+	// Band jump round trip. Tune 80 m with 1 kHz steps, five steps on from
+	// the scan step, then scroll back past the smaller steps to the band
+	// step and jump. VFO A lands where VFO B last left the 20 m band, with
+	// its 100 Hz step. Back from there, 80 m must come back with 1 kHz.
+	freq_t jump_freq = band_stack[1].freq;
+	sim_steps(&ui, &loop, 5);
+	inject_at(&inject, hal_host_ns + 1000000ULL, INJECT_CW, 0);
+	sim_run_until(&ui, &loop, hal_host_ns + 100000000ULL);
+	freq_t back_freq = ui.freq[0];
+	int8_t back_step = ui.step[0];
+	sim_steps(&ui, &loop, -4);
+	unsigned switches = sim_relay_switches;
+	inject_at(&inject, hal_host_ns + 1000000ULL, INJECT_CW, 0);
+	sim_run_until(&ui, &loop, hal_host_ns + 200000000ULL);
+	sim_check("band jump", &ui);
+	if (ui.freq[0] != jump_freq || !ui.usb[0] || ui.step[0] != 2 ||
+	    sim_relay_switches != switches + 1)
+	{
+		printf("FAIL: band jump did not restore the 20 m band\n");
+		++failures;
+	}
+	sim_steps(&ui, &loop, -3);
+	inject_at(&inject, hal_host_ns + 1000000ULL, INJECT_CW, 0);
+	sim_run_until(&ui, &loop, hal_host_ns + 200000000ULL);
+	sim_check("band back", &ui);
+	if (ui.freq[0] != back_freq || ui.usb[0] || back_step != 3 ||
+	    ui.step[0] != back_step)
+	{
+		printf("FAIL: band jump did not restore the 80 m band and step\n");
+		++failures;
+	}
+	printf("relay: %u writes, %u switches\n", sim_relay_writes,
+	       sim_relay_switches);
+	// Only the write at boot may leave the relay as it was
+	if (sim_relay_writes != sim_relay_switches + 1)
+	{
+		printf("FAIL: relay written without a band change\n");
+		++failures;
+	}
+
+#ifdef TRACE
+	for (uint8_t i = 0; i < TRACE_NCHANS; ++i)
+	{
+		const trace_hist_t *hist = &trace_hist[i];
+		const double ms = F_CPU / 1000.0;
+		printf("trace %s: %u edges, min %.3f avg %.3f p99 < %.3f "
+		       "max %.3f ms\n", i == TRACE_RF ? "encoder to RF   " :
+		       "encoder to pixel", hist->count, hist->min / ms,
+		       hist->count ? hist->total / hist->count / ms : 0.0,
+		       trace_p99(hist) / ms, hist->max / ms);
+
+		// Detents that never retune must not wait for a later one
+		if (hist->max / ms > SIM_TRACE_MAX_MS)
+		{
+			printf("FAIL: latency over %d ms\n", SIM_TRACE_MAX_MS);
+			++failures;
+		}
+	}
+	printf("trace: %u edges lost\n", trace_lost);
+
+	// In the burst an edge right after a frame waits for the next one. The
+	// edges lost from the ring must not hide that.
+	if (trace_hist[TRACE_PIXEL].max <
+	    (uint32_t)UI_FRAME_TICKS * TICK_US * (F_CPU / 1000000UL))
+	{
+		printf("FAIL: encoder to pixel below a frame\n");
+		++failures;
+	}
+#endif
+
+	printf("LCD timing violations: %u, bad DDS frames: %u\n",
+	       hd44780_model.violations, dds_model.bad_frames);
+	if (hd44780_model.violations || dds_model.bad_frames)
+		++failures;
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -10,8 +10,7 @@
 // 2009-07-05 initial version / AN
 
 
-#include <avr/interrupt.h>
-
+#include "hal.h"
 #include "util.h"
 #include "interrupt.h"
 
@@ -40,6 +39,7 @@ int8_t read_encoder()
 	cli();
 	rotation = encoder_dir;
 	encoder_dir = 0;
+	TRACE_TAKE();
 	sei();
 	
 	return rotation;
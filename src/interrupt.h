@@ -10,9 +10,10 @@
 // 2009-07-05 initial version / AN
 
 
-#include <avr/interrupt.h>
-
+#include "hal.h"
 #include "util.h"
+#include "prof.h"
+#include "trace.h"
 
 // Encoder port and pins. Note PIN (input, not output)
 #define ENCODER_PORT_OUT PORTD
@@ -41,6 +42,9 @@ void interrupt_init()
 // Interrupt function for handling encoder movement.
 ISR(INT0_vect)
 {
+    PROF_BEGIN(isr);
+    TRACE_EDGE();
+
     // CCW pin high means that it was up when the interrupt triggered
     if (ENCODER_PORT_IN & ENCODER_CCW)
     {
@@ -50,6 +54,8 @@ ISR(INT0_vect)
     {
         --encoder_dir;
     }
+
+    PROF_END(isr, PROF_ISR_INT0);
 }
 
 
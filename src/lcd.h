@@ -10,9 +10,9 @@
 // 2008-03-01 initial version / AN
 
 
-#include <util/delay.h>
-
+#include "hal.h"
 #include "util.h"
+#include "prof.h"
 
  
 // Port and pin definitions
@@ -46,6 +46,7 @@
 void lcd_putnibble(unsigned char byte)
 {
 	unsigned char nibble = 0;
+	PROF_BEGIN(nibble);
 
 	// The bits need to be reversed because of the unusual wiring
 	if (byte & 128)
@@ -58,13 +59,15 @@ void lcd_putnibble(unsigned char byte)
 		nibble |= LCD_DATA4;
 		
 	// set (other bits | data bits)
-	LCD_DATA_PORT = (LCD_DATA_PORT & ~LCD_DATA_PINS) |
-	                (nibble & LCD_DATA_PINS);
+	hal_write(LCD_DATA_PORT, (LCD_DATA_PORT & ~LCD_DATA_PINS) |
+	                         (nibble & LCD_DATA_PINS));
 
 	// Cycle the EN pin, the display should read in the data
-	LCD_CTRL_PORT |= LCD_EN;
+	hal_set(LCD_CTRL_PORT, LCD_EN);
 	_delay_ms(0.5);
-	LCD_CTRL_PORT &= ~LCD_EN;
+	hal_clr(LCD_CTRL_PORT, LCD_EN);
+
+	PROF_END(nibble, PROF_LCD_NIBBLE);
 }
 
 
@@ -74,7 +77,7 @@ void lcd_putnibble(unsigned char byte)
 //! \param byte a character to print
 void lcd_putchar(unsigned char byte)
 {	
-	LCD_CTRL_PORT |= LCD_RS;
+	hal_set(LCD_CTRL_PORT, LCD_RS);
 	lcd_putnibble(byte);
 	lcd_putnibble(byte << 4);
 }
@@ -85,7 +88,7 @@ void lcd_putchar(unsigned char byte)
 //! \param byte A raw command byte
 void lcd_putcmd(unsigned char byte)
 {
-	LCD_CTRL_PORT &= ~LCD_RS;
+	hal_clr(LCD_CTRL_PORT, LCD_RS);
 	lcd_putnibble(byte);
 	lcd_putnibble(byte << 4);
 }
@@ -123,6 +126,15 @@ void lcd_puts(const char *string)
 }
 
 
+//! \short Print a string stored in program memory, e.g. with PSTR().
+void lcd_puts_P(const char *string)
+{
+	char c;
+	while ((c = pgm_read_byte(string++)))
+		lcd_putchar(c);
+}
+
+
 //! \short Uploads a custom character to the display.
 //! The display is left in CHGEN mode.
 //! \param pixels A pointer to a const array of eight unsigned characters
@@ -137,6 +149,16 @@ void lcd_custom_char(const unsigned char *pixels, uint8_t slot)
 }
 
 
+//! \short Uploads a custom character stored in program memory.
+//! Like lcd_custom_char(), the display is left in CHGEN mode.
+void lcd_custom_char_P(const unsigned char *pixels, uint8_t slot)
+{
+	lcd_putcmd(LCD_CGRAM | slot << 3);
+	for (unsigned char i = 0; i < 8; ++i)
+		lcd_putchar(pgm_read_byte(&pixels[i]));
+}
+
+
 //! \short Put the display in DDRAM mode.
 inline void lcd_cmdmode()
 {
@@ -53,6 +53,9 @@ void io_init()
 int main(void)
 {
 	io_init();
+	trace_init();
+	prof_init();
+	tick_init();
 	interrupt_init();
 
 	// Start a new running UI
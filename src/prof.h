@@ -0,0 +1,161 @@
+#ifndef QROLLE_PROF_H
+#define QROLLE_PROF_H
+
+
+// Cycle profiler for the hot paths. Compiled in only when PROFILE is defined
+// (see "make profile"), otherwise the macros expand to nothing.
+//
+// A section is bracketed with PROF_BEGIN(tag) and PROF_END(tag, section).
+// The tag names the local variable holding the start time, which lets the
+// section be decided at the end, e.g. busy vs. idle loop iterations.
+// Times include any interrupts that fire inside the section.
+
+
+#include <inttypes.h>
+
+
+// Profiled sections
+enum prof_section_e
+{
+	PROF_DDS_CMD,     // dds_put_cmd()
+	PROF_LCD_NIBBLE,  // lcd_putnibble()
+	PROF_FREQ_MUL,    // freq_mul()
+	PROF_BCD_TO_STR,  // bcd_to_str()
+	PROF_EEPROM,      // EEPROM block reads and writes
+	PROF_UI_BUSY,     // ui_poll() iterations that did something
+	PROF_UI_IDLE,     // ui_poll() iterations that did nothing
+	PROF_ISR_INT0,    // encoder interrupt
+	PROF_NSECTIONS
+};
+
+
+// Boot milestones
+enum prof_mark_e
+{
+	PROF_MARK_RF,     // DDS running on the right frequency
+	PROF_MARK_FRAME,  // first complete frame on the display
+	PROF_NMARKS
+};
+
+
+#ifdef PROFILE
+
+#include "timer.h"
+
+
+// Accumulated statistics of a single section, in CPU cycles
+typedef struct prof_stat_s
+{
+	uint32_t total;
+	uint32_t max;
+	uint16_t calls;
+} prof_stat_t;
+
+
+prof_stat_t prof_table[PROF_NSECTIONS];
+
+// Cost of an empty PROF_BEGIN/PROF_END pair, subtracted from every sample
+uint16_t prof_overhead;
+
+// Cycle counts at the boot milestones
+cycles_t prof_marks[PROF_NMARKS];
+
+// Set to stop collecting, e.g. while showing the table
+volatile uint8_t prof_paused;
+
+
+#define PROF_BEGIN(tag) cycles_t prof_start_##tag = timer_now()
+#define PROF_END(tag, section) prof_record((section), prof_start_##tag)
+#define PROF_MARK(mark) (prof_marks[mark] = timer_now())
+
+
+//! \short Account the time elapsed since start to a section.
+void prof_record(uint8_t section, cycles_t start)
+{
+	cycles_t elapsed = timer_now() - start;
+
+	if (prof_paused)
+		return;
+
+	if (elapsed > prof_overhead)
+		elapsed -= prof_overhead;
+	else
+		elapsed = 0;
+
+	// Each section is only updated from a single context, so this needs no
+	// locking. Readers must disable interrupts though.
+	prof_stat_t *stat = &prof_table[section];
+	if (elapsed > stat->max)
+		stat->max = elapsed;
+
+	// Stop before the counters overflow, so that the average stays right
+	// for the calls that were counted
+	if (stat->calls == 0xFFFF || stat->total + elapsed < stat->total)
+		return;
+	stat->total += elapsed;
+	++stat->calls;
+}
+
+
+//! \short Clear the collected statistics.
+void prof_reset(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	for (uint8_t i = 0; i < PROF_NSECTIONS; ++i)
+	{
+		prof_table[i].total = 0;
+		prof_table[i].max = 0;
+		prof_table[i].calls = 0;
+	}
+	SREG = sreg;
+}
+
+
+//! \short Atomically copy the statistics of a section.
+void prof_get(uint8_t section, prof_stat_t *stat)
+{
+	uint8_t sreg = SREG;
+	cli();
+	*stat = prof_table[section];
+	SREG = sreg;
+}
+
+
+//! \short Start the cycle counter and measure the profiler overhead.
+void prof_init(void)
+{
+	uint8_t sreg = SREG;
+
+	timer_init();
+
+	// Run empty sections with interrupts off and take the average of
+	// 16 samples as the overhead
+	cli();
+	prof_overhead = 0;
+	for (uint8_t i = 0; i < 16; ++i)
+	{
+		PROF_BEGIN(calib);
+		PROF_END(calib, PROF_UI_IDLE);
+	}
+	prof_overhead = prof_table[PROF_UI_IDLE].total >> 4;
+	SREG = sreg;
+
+	prof_reset();
+}
+
+
+#else // PROFILE
+
+
+#define PROF_BEGIN(tag) do {} while (0)
+#define PROF_END(tag, section) ((void)(section))
+#define PROF_MARK(mark) do {} while (0)
+
+#define prof_init() do {} while (0)
+
+
+#endif // PROFILE
+
+
+#endif // QROLLE_PROF_H
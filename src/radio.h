@@ -10,57 +10,123 @@
 // 2009-07-05 initial version / AN
 
 
-#include "ad9835.h"
+#include "dds.h"
 #include "freq.h"
+#include "band.h"
+#include "trace.h"
 
 
-// Minimum frequency for using 20m band relays
-#define FREQ_20M_LOW 10000000
+// Relay pattern being driven. Not a valid pattern before radio_init().
+uint8_t radio_relay = 0xFF;
 
 
-//! \short Select the correct band.
-//! \param 0 for 80m, 1 for 20m
-inline void set_band_20m(int8_t band)
+//! \short Limit the frequency to the supported range.
+inline freq_t radio_limit(freq_t freq)
 {
-	if (band)
-		BAND_SEL_PORT |= BAND_SEL_PIN;
-	else
-		BAND_SEL_PORT &= ~BAND_SEL_PIN;
+	return band_limit(freq);
 }
 
 
+//! \short Set the band relay, if the pattern changes.
+void radio_setrelay(uint8_t relay)
+{
+	if (relay == radio_relay)
+		return;
+
+	hal_write(BAND_SEL_PORT, (BAND_SEL_PORT & ~BAND_SEL_PINS) | relay);
+	radio_relay = relay;
+}
+
+
+//! \short Set the band relay according to frequency
+inline void radio_setband(freq_t freq)
+{
+	radio_setrelay(band_relay(band_find(freq)));
+}
+
+
+//! \short Tune to a frequency.
+//! The band is left here in its stacking register.
 freq_t radio_setfreq(freq_t freq, int8_t usb)
 {	
-	if (freq < 100000L)
-		freq = 100000L;
-	else if (freq > 20000000L)
-		freq = 20000000L;
-
-	// Calculate the VFO frequency from the RX freq
-	// LSB reception needs f_vfo > f_if
-	// USB reception needs f_vfo < f_if
-	freq_t vfo_freq = freq_vfo(freq, usb);
-	
-	// Calculate the frequency word that is sent to AD9835
-	freqword_t freqword = freq_mul(vfo_freq);
+	freq = radio_limit(freq);
+	int8_t band = band_find(freq);
+
+	// Calculate the frequency word that is sent to AD9835 from the VFO
+	// frequency for the RX freq
+	freqword_t freqword = freq_vfo_word(freq, usb);
 	
 	// Upload the frequency word to AD9835
 	dds_put_freq(freqword);
+	TRACE_DONE(TRACE_RF);
 	
-	// Set the band relay according to frequency
-	if (freq > FREQ_20M_LOW)
-		set_band_20m(1);
-	else
-		set_band_20m(0);
+	radio_setrelay(band_relay(band));
+
+	band_stack[band].freq = freq;
+	band_stack[band].word = freqword;
+	band_stack[band].usb = usb;
 		
 	return freq;
 }
 
 
-void radio_init(void)
+//! \short Jump to where a band was last left.
+//! The word comes from the stacking register, so this is just the DDS
+//! upload and the relay.
+//! \return the frequency of the band
+freq_t radio_jump(int8_t band)
 {
-	dds_init();
+	const band_stack_t *stack = &band_stack[band];
+
+	dds_put_freq(stack->word);
+	TRACE_DONE(TRACE_RF);
+	radio_setrelay(band_relay(band));
+
+	return stack->freq;
+}
+
+
+//! \short Load a frequency into the second DDS frequency register.
+//! The DDS keeps running on the first one until radio_hop() is called.
+freq_t radio_preload(freq_t freq, int8_t usb)
+{
+	freq = radio_limit(freq);
+	dds_put_freqreg(1, freq_vfo_word(freq, usb));
+
+	return freq;
+}
+
+
+//! \short Switch the DDS output to a frequency register.
+//! A single DDS command, plus the band relay if freq is on another band.
+//! \param reg 0 for the frequency set with radio_setfreq(), 1 for the one
+//! loaded with radio_preload()
+//! \param freq the frequency in that register
+void radio_hop(uint8_t reg, freq_t freq)
+{
+	dds_select(reg, 0);
+	radio_setband(freq);
+}
+
+
+//! \short Bring up the DDS directly on the given frequency.
+//! The output stays asleep until the right word has been loaded.
+freq_t radio_init(freq_t freq, int8_t usb)
+{
+	freq = radio_limit(freq);
+	freqword_t freqword = freq_vfo_word(freq, usb);
+	dds_init(freqword);
+	radio_setband(freq);
+
+	// The other bands can wait until the RF is up
+	band_init();
+	int8_t band = band_find(freq);
+	band_stack[band].freq = freq;
+	band_stack[band].word = freqword;
+	band_stack[band].usb = usb;
+
+	return freq;
 }
 
 
-#endif // QROLLE_RADIO_H
\ No newline at end of file
+#endif // QROLLE_RADIO_H
@@ -0,0 +1,97 @@
+#ifndef QROLLE_TICK_H
+#define QROLLE_TICK_H
+
+
+// System tick from Timer0 for pacing things that must not block, like
+// display refresh. Timer0 runs at clk/64, so the counter advances every
+// 16 us and overflows into a new tick every 4.096 ms at 4 MHz.
+
+
+#include <inttypes.h>
+
+#include "hal.h"
+
+
+// Tick length in microseconds
+#define TICK_US (64UL * 256UL * 1000000UL / F_CPU)
+
+// Number of ticks in given milliseconds, rounded up. Compile-time constant.
+#define TICKS(ms) ((tick_t)(((ms) * 1000UL + TICK_US - 1) / TICK_US))
+
+// Fine timestamp units in microseconds
+#define TICK_FINE_US (64UL * 1000000UL / F_CPU)
+
+
+// Ticks since start. Wraps around after about 4.5 minutes, compare
+// differences only.
+typedef uint16_t tick_t;
+
+
+#ifdef QROLLE_HOST
+
+
+// The host build derives the ticks from the virtual clock
+#define tick_init() do {} while (0)
+#define tick_now() ((tick_t)(hal_host_ns / (TICK_US * 1000ULL)))
+#define tick_fine() ((uint16_t)(hal_host_ns / (TICK_FINE_US * 1000ULL)))
+
+
+#else // QROLLE_HOST
+
+
+volatile tick_t tick_count;
+
+
+//! \short Start Timer0 and the tick interrupt.
+void tick_init(void)
+{
+	TCCR0 = (1 << CS01) | (1 << CS00); // clk/64
+	TIMSK |= (1 << TOIE0);
+}
+
+
+ISR(TIMER0_OVF_vect)
+{
+	++tick_count;
+}
+
+
+//! \short Read the tick counter.
+tick_t tick_now(void)
+{
+	uint8_t sreg = SREG;
+	tick_t now;
+
+	cli();
+	now = tick_count;
+	SREG = sreg;
+
+	return now;
+}
+
+
+//! \short Fine timestamp in TICK_FINE_US units for measuring short gaps.
+//! Wraps around about once a second.
+uint16_t tick_fine(void)
+{
+	uint8_t sreg = SREG;
+	uint8_t lo;
+	uint16_t hi;
+
+	cli();
+	lo = TCNT0;
+	hi = tick_count;
+	// An overflow that happened while interrupts were disabled has not
+	// been counted yet
+	if ((TIFR & (1 << TOV0)) && lo < 0x80)
+		++hi;
+	SREG = sreg;
+
+	return (hi << 8) | lo;
+}
+
+
+#endif // QROLLE_HOST
+
+
+#endif // QROLLE_TICK_H
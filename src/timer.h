@@ -0,0 +1,73 @@
+#ifndef QROLLE_TIMER_H
+#define QROLLE_TIMER_H
+
+
+// Free-running 32-bit CPU cycle counter built on Timer1. Only used by the
+// profiling and tracing builds.
+
+
+#include <inttypes.h>
+
+#include "hal.h"
+
+
+// Cycle counts. Wraps around after about 18 minutes at 4 MHz.
+typedef uint32_t cycles_t;
+
+
+#ifdef QROLLE_HOST
+
+
+// The host build counts cycles of the virtual clock instead
+#define timer_init() do {} while (0)
+#define timer_now() ((cycles_t)hal_host_cycles())
+
+
+#else // QROLLE_HOST
+
+
+// Upper 16 bits of the cycle counter, incremented on Timer1 overflow
+volatile uint16_t timer_overflows;
+
+
+//! \short Start Timer1 at full CPU clock.
+void timer_init(void)
+{
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10); // no prescaling
+	TCNT1 = 0;
+	TIMSK |= (1 << TOIE1);
+}
+
+
+// Extend the 16-bit hardware counter
+ISR(TIMER1_OVF_vect)
+{
+	++timer_overflows;
+}
+
+
+//! \short Read the cycle counter.
+//! Safe to call from interrupt handlers and with interrupts disabled.
+cycles_t timer_now(void)
+{
+	uint8_t sreg = SREG;
+	uint16_t lo, hi;
+
+	cli();
+	lo = TCNT1;
+	hi = timer_overflows;
+	// An overflow that happened while interrupts were disabled has not been
+	// counted yet. A small low word means it happened before reading TCNT1.
+	if ((TIFR & (1 << TOV1)) && lo < 0x8000)
+		++hi;
+	SREG = sreg;
+
+	return ((cycles_t)hi << 16) | lo;
+}
+
+
+#endif // QROLLE_HOST
+
+
+#endif // QROLLE_TIMER_H
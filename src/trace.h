@@ -0,0 +1,241 @@
+#ifndef QROLLE_TRACE_H
+#define QROLLE_TRACE_H
+
+
+// Encoder-to-RF and encoder-to-pixel latency tracer. Compiled in only when
+// TRACE is defined (see "make trace"), otherwise the macros expand to
+// nothing.
+//
+// The encoder interrupt timestamps every edge into a small ring indexed by
+// a free-running sequence number. read_encoder() notes the sequence number
+// it has consumed up to. When the last FSYNC of the resulting DDS update
+// rises, and when the last byte of the frequency line has been written,
+// every edge up to that number is accounted to the respective channel.
+//
+// A fast spin overwrites the oldest edges, which are the slowest ones to be
+// accounted. The oldest unaccounted edge of each channel is therefore kept
+// aside, and the overwritten edges are charged its latency, so that the
+// maximum and the percentiles err on the high side.
+
+
+#include <inttypes.h>
+
+
+// Latency channels
+enum trace_chan_e
+{
+	TRACE_RF,     // edge to the last FSYNC of the DDS update
+	TRACE_PIXEL,  // edge to the last LCD byte of the frequency line
+	TRACE_NCHANS
+};
+
+
+#ifdef TRACE
+
+#include <string.h>
+
+#include "timer.h"
+
+
+// Edge timestamps kept, power of two
+#define TRACE_RING 8
+
+// Histogram buckets. Bucket 0 holds latencies below 2^TRACE_SHIFT cycles,
+// bucket n those below 2^(TRACE_SHIFT + n).
+#define TRACE_BUCKETS 16
+#define TRACE_SHIFT   6
+
+
+// Latency statistics of a channel, in CPU cycles
+typedef struct trace_hist_s
+{
+	uint32_t min;
+	uint32_t max;
+	uint32_t total;
+	uint16_t count;
+	uint16_t bucket[TRACE_BUCKETS];
+} trace_hist_t;
+
+
+trace_hist_t trace_hist[TRACE_NCHANS];
+
+// Timestamps of the latest edges, indexed by sequence number
+cycles_t trace_edges[TRACE_RING];
+
+// Sequence number of the next edge
+volatile uint8_t trace_head;
+
+// Sequence number up to which the edges have been read
+uint8_t trace_taken;
+
+// Timestamp of the edge at trace_taken, once it has come
+cycles_t trace_next;
+
+// Sequence number up to which each channel has accounted the edges
+uint8_t trace_tail[TRACE_NCHANS];
+
+// Timestamp of the edge at the tail of each channel, once it has come
+cycles_t trace_first[TRACE_NCHANS];
+
+// Edges that fell out of the ring before being accounted, saturating
+uint16_t trace_lost;
+
+
+//! \short Timestamp an encoder edge. Call from the interrupt handler.
+inline void trace_edge(void)
+{
+	cycles_t now = timer_now();
+
+	if (trace_head == trace_taken)
+		trace_next = now;
+	for (uint8_t i = 0; i < TRACE_NCHANS; ++i)
+		if (trace_head == trace_tail[i])
+			trace_first[i] = now;
+
+	trace_edges[trace_head & (TRACE_RING - 1)] = now;
+	++trace_head;
+}
+
+
+//! \short Note that the edges so far have been read. Interrupts disabled.
+inline void trace_take(void)
+{
+	trace_taken = trace_head;
+}
+
+
+//! \short Add a sample to a histogram.
+void trace_add(trace_hist_t *hist, uint32_t latency)
+{
+	// Stop before the counters overflow
+	if (hist->count == 0xFFFF || hist->total + latency < hist->total)
+		return;
+
+	if (!hist->count || latency < hist->min)
+		hist->min = latency;
+	if (latency > hist->max)
+		hist->max = latency;
+	hist->total += latency;
+	++hist->count;
+
+	uint8_t bucket = 0;
+	for (uint32_t l = latency >> TRACE_SHIFT;
+	     l && bucket < TRACE_BUCKETS - 1; l >>= 1)
+		++bucket;
+	++hist->bucket[bucket];
+}
+
+
+//! \short Move the tail of a channel to the edges read so far.
+//! Interrupts disabled.
+void trace_settle(uint8_t chan)
+{
+	trace_tail[chan] = trace_taken;
+	if (trace_head != trace_taken)
+		trace_first[chan] = trace_next;
+}
+
+
+//! \short Account the edges read so far to a channel.
+void trace_done(uint8_t chan)
+{
+	cycles_t edges[TRACE_RING];
+	uint8_t sreg = SREG;
+
+	// Copy the edges still in the ring before the interrupt reuses them
+	cli();
+	cycles_t now = timer_now();
+	cycles_t first = trace_first[chan];
+	uint8_t pending = trace_taken - trace_tail[chan];
+	uint8_t newer = trace_head - trace_taken;
+	uint8_t kept = newer < TRACE_RING ? TRACE_RING - newer : 0;
+	if (kept > pending)
+		kept = pending;
+	for (uint8_t i = 0; i < kept; ++i)
+		edges[i] = trace_edges[(uint8_t)(trace_taken - kept + i) &
+		                       (TRACE_RING - 1)];
+	trace_settle(chan);
+	SREG = sreg;
+
+	// The overwritten edges are older than the ones kept, charge them the
+	// latency of the oldest
+	uint8_t lost = pending - kept;
+	if (trace_lost > 0xFFFF - lost)
+		trace_lost = 0xFFFF;
+	else
+		trace_lost += lost;
+	for (; lost; --lost)
+		trace_add(&trace_hist[chan], now - first);
+
+	for (uint8_t i = 0; i < kept; ++i)
+		trace_add(&trace_hist[chan], now - edges[i]);
+}
+
+
+//! \short Forget the edges read so far, e.g. when they changed the step.
+void trace_discard(void)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	for (uint8_t i = 0; i < TRACE_NCHANS; ++i)
+		trace_settle(i);
+	SREG = sreg;
+}
+
+
+//! \short Upper bound of the 99th percentile latency, in cycles.
+//! Exact to the histogram resolution, i.e. within a factor of two.
+uint32_t trace_p99(const trace_hist_t *hist)
+{
+	// Samples allowed above the percentile
+	uint16_t above = hist->count / 100;
+	uint16_t seen = 0;
+	int8_t i;
+
+	for (i = TRACE_BUCKETS - 1; i > 0; --i)
+	{
+		seen += hist->bucket[i];
+		if (seen > above)
+			break;
+	}
+
+	if (i == TRACE_BUCKETS - 1)
+		return hist->max;
+	uint32_t bound = (uint32_t)1 << (TRACE_SHIFT + i);
+	return bound < hist->max ? bound : hist->max;
+}
+
+
+//! \short Clear the statistics.
+void trace_reset(void)
+{
+	memset(trace_hist, 0, sizeof(trace_hist));
+	trace_lost = 0;
+}
+
+
+//! \short Start the cycle counter.
+#define trace_init() timer_init()
+
+#define TRACE_EDGE() trace_edge()
+#define TRACE_TAKE() trace_take()
+#define TRACE_DONE(chan) trace_done(chan)
+#define TRACE_DISCARD() trace_discard()
+
+
+#else // TRACE
+
+
+#define trace_init() do {} while (0)
+
+#define TRACE_EDGE() do {} while (0)
+#define TRACE_TAKE() do {} while (0)
+#define TRACE_DONE(chan) do {} while (0)
+#define TRACE_DISCARD() do {} while (0)
+
+
+#endif // TRACE
+
+
+#endif // QROLLE_TRACE_H
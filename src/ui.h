@@ -11,18 +11,20 @@
 // 2009-04-15 Initial version / AN
 
 
-#include <util/delay.h>
 #include <stddef.h>
-#include <avr/eeprom.h>
 
+#include "hal.h"
 #include "lcd.h"
 #include "radio.h"
 #include "inputs.h"
 #include "adc.h"
+#include "prof.h"
+#include "trace.h"
+#include "tick.h"
 
 // Hardcoded number of supported VFOs and steps.
 #define NUM_VFOS 2
-#define NUM_STEPS 7
+#define NUM_STEPS 10
 
 // Number of physical steps the encoder has to be turned in slow (step) mode
 // to count as one logical step
@@ -32,14 +34,65 @@
 #define UI_FIRSTLINE (1 << 0)
 #define UI_SECONDLINE (1 << 1)
 
+// Shortest time between two display frames, 25 Hz
+#define UI_FRAME_TICKS TICKS(40)
 
-#define UI_MAGIC_NUM 124
+// What turning the knob does in each step
+#define STEP_TUNE 0
+#define STEP_SIDEBAND 1
+#define STEP_WATCH 2
+#define STEP_SCAN 3
+#define STEP_BAND 4
 
+// Dual watch modes, cycled by turning the knob in the watch step
+#define WATCH_OFF 0
+#define WATCH_ON 1
+#define WATCH_AUTO 2 // also switch over to the other VFO when it is busy
+#define WATCH_NMODES 3
 
+// Dual watch timing. Every WATCH_PERIOD_TICKS the DDS hops to the other
+// VFO, waits for the IF filter and AGC to settle, averages
+// 2^WATCH_SAMPLES_LOG2 ADC samples and hops back. Hops across bands also
+// wait for the relay, both ways.
+#define WATCH_PERIOD_TICKS TICKS(1000)
+#define WATCH_SETTLE_US 2000
+#define WATCH_RELAY_MS 5
+#define WATCH_SAMPLES_LOG2 2
+
+// Level of the other VFO that makes WATCH_AUTO switch over, when the
+// current one is below it
+#define WATCH_THRESHOLD 128
+
+// Width of the other VFO's S-meter in characters
+#define UI_WATCH_WIDTH 5
+
+// Scanner states
+#define SCAN_OFF 0
+#define SCAN_SETTLE 1 // retuned, waiting for the receiver to settle
+#define SCAN_DWELL 2  // close to the squelch, listening a bit longer
+#define SCAN_BUSY 3   // stopped on a signal
+
+// Scanner timing. After each retune the receiver gets SCAN_SETTLE_US to
+// settle. A channel well below the squelch is left right away, one closer
+// to it gets another SCAN_DWELL_US. On a signal above SCAN_SQUELCH the
+// scanner stops and resumes once the signal has been gone for
+// SCAN_HOLD_TICKS.
+#define SCAN_STEP 0x1000UL
+#define SCAN_SETTLE_US 5000UL
+#define SCAN_DWELL_US 20000UL
+#define SCAN_SQUELCH 128
+#define SCAN_HOLD_TICKS TICKS(2000)
+
+
+#define UI_MAGIC_NUM 125
+
+
+// Stored in program memory, read with pgm_read_*()
 typedef struct step_s
 {
-	const char *name;
+	char name[8];
 	freq_t step;
+	int8_t mode;
 } step_t;
 
 
@@ -55,15 +108,62 @@ typedef struct ui_s
 } ui_t;
 
 
-const step_t steps[NUM_STEPS] =
+// Run-time state of the UI loop. Not saved to EEPROM.
+typedef struct ui_loop_s
+{
+	int8_t rotation;    // local step counter
+	int8_t held_down;   // button held down while turning
+	int8_t smeter_last; // last S-meter value
+	
+	// Redraw scheduling
+	uint8_t dirty;      // lines waiting to be drawn
+	tick_t last_frame;  // when the last frame was drawn
+	uint16_t frames;    // frames drawn
+	uint16_t dropped;   // line updates overwritten before being drawn
+	
+	// Dual watch
+	int8_t watch;            // WATCH_OFF, WATCH_ON or WATCH_AUTO
+	uint8_t watch_level;     // S-meter of the other VFO
+	tick_t watch_last;       // when the last hop ended
+	uint16_t watch_gap;      // length of the last hop in TICK_FINE_US
+	uint16_t watch_gap_max;  // longest hop in TICK_FINE_US
+	
+	// Scanner
+	int8_t scan;             // SCAN_OFF, SCAN_SETTLE, SCAN_DWELL or SCAN_BUSY
+	int8_t scan_up;          // direction
+	freq_t scan_lo;          // range, from the VFO frequencies
+	freq_t scan_hi;
+	uint16_t scan_since;     // tick_fine() of the last retune
+	tick_t scan_quiet;       // last time the signal was above the squelch
+	tick_t scan_window;      // start of the current rate window
+	bcd_t scan_count;        // channels in the current window
+	bcd_t scan_rate;         // channels in the last full window, per second
+} ui_loop_t;
+
+
+// Step sizes in packed BCD
+const step_t steps[NUM_STEPS] PROGMEM =
+{
+	{"    U/L", 0, STEP_SIDEBAND},
+	{"  10 Hz", 0x10, STEP_TUNE},
+	{" 100 Hz", 0x100, STEP_TUNE},
+	{"  1 kHz", 0x1000, STEP_TUNE},
+	{" 10 kHz", 0x10000, STEP_TUNE},
+	{"100 kHz", 0x100000, STEP_TUNE},
+	{"  1 MHz", 0x1000000, STEP_TUNE},
+	{"  Watch", 0, STEP_WATCH},
+	{"   Scan", 0, STEP_SCAN},
+	{"   Band", 0, STEP_BAND}
+};
+
+
+// S-meter blocks with zero to three bars, in CGRAM slots 0-3
+const unsigned char ui_glyphs[4][8] PROGMEM =
 {
-	{"    U/L", 0},
-	{"  10 Hz", 10},
-	{" 100 Hz", 100},
-	{"  1 kHz", 1000},
-	{" 10 kHz", 10000},
-	{"100 kHz", 100000},
-	{"  1 MHz", 1000000}
+	{21, 00, 00, 00, 00, 00, 21, 00},
+	{21, 16, 16, 16, 16, 16, 21, 00},
+	{21, 20, 20, 20, 20, 20, 21, 00},
+	{21, 21, 21, 21, 21, 21, 21, 00}
 };
 
 
@@ -74,11 +174,12 @@ ui_t EEMEM eeprom_settings_addr;
 //! Consists of frequency, sideband and vfo indicators
 void ui_freqline(const freq_t *freq, int8_t usb, int8_t vfo)
 {
-	lcd_home();
+	// Setting the address is as good as home and much faster
+	lcd_putcmd(LCD_DDRAM);
 
 	// Frequency, with two dots
 	char buf[8];
-	int_to_str(buf, 8, *freq);
+	bcd_to_str(buf, 8, *freq);
 	for (size_t i = 0; i < 7; ++i)
 	{
 		lcd_putchar(buf[i]);
@@ -94,18 +195,25 @@ void ui_freqline(const freq_t *freq, int8_t usb, int8_t vfo)
 		lcd_putchar('L');
 	
 	// VFO
-	lcd_puts(" VFO");
+	lcd_puts_P(PSTR(" VFO"));
 	lcd_putchar('A' + vfo);
 }
 
 
-//! \short Draw the S-meter, which is 8 chars wide.
-void ui_smeter(uint8_t s_meter)
+//! \short Number of S-meter bars for an ADC reading.
+//! There are 3 bars/char, e.g. 3 bars/char * 8 chars = 24 bars.
+inline uint8_t ui_smeter_bars(uint8_t s_meter, uint8_t width)
+{
+	return ((uint16_t)s_meter * (3 * width) >> 8) + 1;
+}
+
+
+//! \short Draw an S-meter of given width in chars.
+void ui_smeter(uint8_t s_meter, uint8_t width)
 {
 	// Draw the meter in 3-bar blocks
-	// There are a total of 3 bars/char * 8 chars = 24 bars.
-	uint16_t numblocks = s_meter * 24 / 256 + 1;
-	for (int8_t i = 0; i < 8; ++i)
+	uint8_t numblocks = ui_smeter_bars(s_meter, width);
+	for (uint8_t i = 0; i < width; ++i)
 	{
 		uint8_t decrement = numblocks;
 		if (numblocks > 3)
@@ -118,88 +226,327 @@ void ui_smeter(uint8_t s_meter)
 
 //! \short Print the second line.
 //! S-meter and step.
+//! \param step the step name in program memory
 void ui_smeterline(uint8_t s_meter, const char *step)
 {
 	// S-meter
 	lcd_row2();
-	ui_smeter(s_meter);
+	ui_smeter(s_meter, 8);
 	
 	// Step indicator
 	lcd_putchar(' ');
-	lcd_puts(step);
+	lcd_puts_P(step);
+}
+
+
+//! \short Print the second line in dual watch.
+//! S-meter, then the other VFO and its S-meter. '+' marks WATCH_AUTO.
+void ui_watchline(uint8_t s_meter, int8_t other, int8_t watch, uint8_t level)
+{
+	lcd_row2();
+	ui_smeter(s_meter, 8);
+	
+	lcd_putchar(' ');
+	lcd_putchar('A' + other);
+	lcd_putchar(watch == WATCH_AUTO ? '+' : ' ');
+	ui_smeter(level, UI_WATCH_WIDTH);
+}
+
+
+//! \short Print the second line while scanning.
+//! S-meter, then channels per second or Busy when stopped on a signal.
+void ui_scanline(uint8_t s_meter, int8_t scan, bcd_t rate)
+{
+	lcd_row2();
+	ui_smeter(s_meter, 8);
+	
+	lcd_putchar(' ');
+	if (scan == SCAN_BUSY)
+	{
+		lcd_puts_P(PSTR("   Busy"));
+	}
+	else
+	{
+		char buf[3];
+		bcd_to_str(buf, 3, rate);
+		for (uint8_t i = 0; i < 3; ++i)
+			lcd_putchar(buf[i]);
+		lcd_puts_P(PSTR("ch/s"));
+	}
 }
 
 
-void ui_draw(ui_t *ui, uint8_t lines)
+void ui_draw(ui_t *ui, const ui_loop_t *loop, uint8_t lines)
 {
 	if (lines & UI_FIRSTLINE)
 	{
 		ui_freqline(&ui->freq[ui->vfo], ui->usb[ui->vfo], ui->vfo);
+		TRACE_DONE(TRACE_PIXEL);
 	}
 	if (lines & UI_SECONDLINE)
 	{
-		ui_smeterline(ui->smeter, steps[ui->step[ui->vfo]].name);
+		// The step is shown while it is being changed
+		if (loop->held_down)
+			ui_smeterline(ui->smeter, steps[ui->step[ui->vfo]].name);
+		else if (loop->scan)
+			ui_scanline(ui->smeter, loop->scan, loop->scan_rate);
+		else if (loop->watch)
+			ui_watchline(ui->smeter, ui->vfo ^ 1, loop->watch,
+			             loop->watch_level);
+		else
+			ui_smeterline(ui->smeter, steps[ui->step[ui->vfo]].name);
+	}
+}
+
+
+//! \short Mark lines to be redrawn on the next frame.
+void ui_invalidate(ui_loop_t *loop, uint8_t lines)
+{
+	// An update that was never shown is a dropped frame
+	if (loop->dirty & lines)
+		++loop->dropped;
+	loop->dirty |= lines;
+}
+
+
+//! \short Draw the lines marked dirty, at most once per frame time.
+//! The frequency line goes first. While the knob keeps turning, the second
+//! line waits so that the display keeps up with the tuning.
+//! \return 1 if something was drawn
+uint8_t ui_flush(ui_t *ui, ui_loop_t *loop)
+{
+	if (!loop->dirty)
+		return 0;
+
+	tick_t now = tick_now();
+	if ((tick_t)(now - loop->last_frame) < UI_FRAME_TICKS)
+		return 0;
+
+	uint8_t lines = loop->dirty;
+	if ((lines & UI_FIRSTLINE) && encoder_dir)
+		lines = UI_FIRSTLINE;
+
+	loop->dirty &= ~lines;
+	ui_draw(ui, loop, lines);
+	loop->last_frame = now;
+	++loop->frames;
+	return 1;
+}
+
+
+//! \short Load the other VFO into the second DDS frequency register.
+void ui_watch_preload(ui_t *ui)
+{
+	int8_t other = ui->vfo ^ 1;
+	ui->freq[other] = radio_preload(ui->freq[other], ui->usb[other]);
+}
+
+
+//! \short Change the dual watch mode by the given number of detents.
+void ui_watch_mode(ui_t *ui, ui_loop_t *loop, int8_t rotation)
+{
+	while (rotation > 0)
+	{
+		--rotation;
+		if (++loop->watch >= WATCH_NMODES)
+			loop->watch = WATCH_OFF;
+	}
+	while (rotation < 0)
+	{
+		++rotation;
+		if (--loop->watch < 0)
+			loop->watch = WATCH_NMODES - 1;
+	}
+
+	// The first hop waits for a full period
+	if (loop->watch)
+	{
+		ui_watch_preload(ui);
+		loop->watch_last = tick_now();
+	}
+	ui_invalidate(loop, UI_SECONDLINE);
+}
+
+
+//! \short Retune the scanner to the next channel.
+//! Wraps around at the ends of the range.
+void ui_scan_next(ui_t *ui, ui_loop_t *loop)
+{
+	int8_t vfo = ui->vfo;
+	freq_t freq = ui->freq[vfo];
+
+	if (loop->scan_up)
+	{
+		freq = bcd_add_sat(freq, SCAN_STEP);
+		if (freq > loop->scan_hi)
+			freq = loop->scan_lo;
+	}
+	else
+	{
+		freq = bcd_sub_sat(freq, SCAN_STEP);
+		if (freq < loop->scan_lo)
+			freq = loop->scan_hi;
+	}
+
+	ui->freq[vfo] = radio_setfreq(freq, ui->usb[vfo]);
+	ui_invalidate(loop, UI_FIRSTLINE);
+
+	loop->scan = SCAN_SETTLE;
+	loop->scan_since = tick_fine();
+	loop->scan_count = bcd_add(loop->scan_count, 1);
+}
+
+
+//! \short Start or stop the scanner.
+//! The range is from the current VFO to the other one, a clockwise turn
+//! scans up and a counterclockwise one down.
+void ui_scan_mode(ui_t *ui, ui_loop_t *loop, int8_t rotation)
+{
+	ui_invalidate(loop, UI_SECONDLINE);
+	if (loop->scan)
+	{
+		// Stopping does not retune
+		loop->scan = SCAN_OFF;
+		TRACE_DISCARD();
+		return;
 	}
+
+	freq_t freq = ui->freq[ui->vfo];
+	freq_t other = ui->freq[ui->vfo ^ 1];
+	loop->scan_lo = freq < other ? freq : other;
+	loop->scan_hi = freq < other ? other : freq;
+	loop->scan_up = rotation > 0;
+	loop->scan_window = tick_now();
+	loop->scan_count = 0;
+	loop->scan_rate = 0;
+	ui_scan_next(ui, loop);
+}
+
+
+//! \short Remember the step of the current VFO in the band it is on.
+//! Only tuning steps count, the others do not stay with a band.
+void ui_band_remember(ui_t *ui)
+{
+	int8_t vfo = ui->vfo;
+	if (pgm_read_byte(&steps[ui->step[vfo]].mode) == STEP_TUNE)
+		band_stack[band_find(ui->freq[vfo])].step = ui->step[vfo];
+}
+
+
+//! \short Jump bands, one band per detent.
+//! The VFO takes the frequency, sideband and step the band was left with,
+//! so the step goes back to tuning.
+void ui_band_jump(ui_t *ui, ui_loop_t *loop, int8_t rotation)
+{
+	int8_t vfo = ui->vfo;
+	int8_t band = band_find(ui->freq[vfo]);
+
+	while (rotation > 0)
+	{
+		--rotation;
+		if (++band >= NUM_BANDS)
+			band = 0;
+	}
+	while (rotation < 0)
+	{
+		++rotation;
+		if (--band < 0)
+			band = NUM_BANDS - 1;
+	}
+
+	ui->freq[vfo] = radio_jump(band);
+	ui->usb[vfo] = band_stack[band].usb;
+	ui->step[vfo] = band_stack[band].step;
+	loop->scan = SCAN_OFF;
+	ui_invalidate(loop, UI_FIRSTLINE | UI_SECONDLINE);
 }
 
 
 //! \short Handle the encoder rotation
+//! All the detents accumulated since the last call are applied at once, so
+//! a batch costs a single DDS upload and redraw however long the main loop
+//! was busy.
 //! \param rotation the number of steps the encoder has been turned.
 //! Negative means counterclockwise.
-int8_t encoder_turned(ui_t *ui, int8_t rotation, int8_t button_down)
+//! \return the detents not used yet
+int8_t encoder_turned(ui_t *ui, ui_loop_t *loop, int8_t rotation,
+                      int8_t button_down)
 {
 	// These will be used later
 	int8_t vfo = ui->vfo;
-	freq_t step = steps[ui->step[vfo]].step;
+	freq_t step = pgm_read_dword(&steps[ui->step[vfo]].step);
 
-	// Change step
+	// Change step, one for every SLOW_TRESHOLD detents. The rest is kept
+	// for the next turn as hysteresis.
 	if (button_down)
 	{
-		// Some hysteresis
-		if (rotation > -SLOW_TRESHOLD && rotation < SLOW_TRESHOLD)
-			return rotation;
+		int8_t newstep = ui->step[vfo];
 		
-		// Change step
-		if (rotation < 0)
+		while (rotation <= -SLOW_TRESHOLD)
 		{
-			--ui->step[vfo];
-			if (ui->step[vfo] < 0)
-				ui->step[vfo] = NUM_STEPS - 1;
+			rotation += SLOW_TRESHOLD;
+			if (--newstep < 0)
+				newstep = NUM_STEPS - 1;
 		}
-		else
+		while (rotation >= SLOW_TRESHOLD)
 		{
-			++ui->step[vfo];
-			if (ui->step[vfo] >= NUM_STEPS)
-				ui->step[vfo] = 0;
+			rotation -= SLOW_TRESHOLD;
+			if (++newstep >= NUM_STEPS)
+				newstep = 0;
 		}
 
-		ui_draw(ui, UI_SECONDLINE);
+		if (newstep != ui->step[vfo])
+		{
+			ui->step[vfo] = newstep;
+			loop->scan = SCAN_OFF;
+			ui_invalidate(loop, UI_SECONDLINE);
+		}
+		return rotation;
 	}
 
-	// Change freq or sb
-	else
+	// Change freq, sb or dual watch
+	uint8_t detents = rotation < 0 ? -rotation : rotation;
+	int8_t mode = pgm_read_byte(&steps[ui->step[vfo]].mode);
+	if (mode == STEP_WATCH)
 	{
-		if (step)
-		{
-			if (rotation < 0)
-			{
-				ui->freq[ui->vfo] -= step;
-				if (ui->freq[ui->vfo] < 100000)
-					ui->freq[ui->vfo] = 100000;
-			}
-			else
-			{
-				ui->freq[ui->vfo] += step;
-			}
-		}
+		// No retune, so nothing for the tracer to wait for
+		ui_watch_mode(ui, loop, rotation);
+		TRACE_DISCARD();
+		return 0;
+	}
+	else if (mode == STEP_SCAN)
+	{
+		ui_scan_mode(ui, loop, rotation);
+		return 0;
+	}
+	else if (mode == STEP_BAND)
+	{
+		ui_band_jump(ui, loop, rotation);
+		return 0;
+	}
+	else if (mode == STEP_TUNE)
+	{
+		// rotation * step, saturating. radio_setfreq() then clamps the
+		// result to the supported range.
+		freq_t delta = bcd_mul_pow10(step, detents);
+		if (rotation < 0)
+			ui->freq[vfo] = bcd_sub_sat(ui->freq[vfo], delta);
 		else
-		{
+			ui->freq[vfo] = bcd_add_sat(ui->freq[vfo], delta);
+	}
+	else
+	{
+		// Every detent flips the sideband
+		if (detents & 1)
 			ui->usb[vfo] = !ui->usb[vfo];
-		}
-		
-		ui->freq[vfo] = radio_setfreq(ui->freq[vfo], ui->usb[vfo]);
-		ui_draw(ui, UI_FIRSTLINE);
 	}
+		
+	// RF immediately, the display when there is time
+	ui->freq[vfo] = radio_setfreq(ui->freq[vfo], ui->usb[vfo]);
+	ui_invalidate(loop, UI_FIRSTLINE);
+
+	// The band is tuned with this step
+	ui_band_remember(ui);
 
 	// really did something, position reset.
 	return 0;
@@ -207,133 +554,520 @@ int8_t encoder_turned(ui_t *ui, int8_t rotation, int8_t button_down)
 
 
 //! \short Handle short button presses for the UI
-void button_shortpress(ui_t *ui)
+void button_shortpress(ui_t *ui, ui_loop_t *loop)
 {
+	// A press while scanning only stops the scanner
+	if (loop->scan)
+	{
+		loop->scan = SCAN_OFF;
+		ui_invalidate(loop, UI_SECONDLINE);
+		return;
+	}
+
 	// Grow VFO number until it overflows
 	++ui->vfo;
 	if (ui->vfo >= NUM_VFOS)
 		ui->vfo = 0;
 		
 	ui->freq[ui->vfo] = radio_setfreq(ui->freq[ui->vfo], ui->usb[ui->vfo]);
-	ui_draw(ui, UI_FIRSTLINE | UI_SECONDLINE);
+	ui_invalidate(loop, UI_FIRSTLINE | UI_SECONDLINE);
+	ui_band_remember(ui);
+	
+	// The VFOs swap places in the DDS registers too. The last S-meter
+	// reading belongs to the VFO that is now the other one.
+	if (loop->watch)
+	{
+		ui_watch_preload(ui);
+		loop->watch_level = (uint8_t)loop->smeter_last;
+	}
+}
+
+
+//! \short Listen to the other VFO for a moment and measure its level.
+//! Blocks for the settle time and the samples, the encoder keeps counting
+//! meanwhile. The gap in reception is measured with tick_fine().
+void ui_watch(ui_t *ui, ui_loop_t *loop)
+{
+	int8_t vfo = ui->vfo;
+	int8_t other = vfo ^ 1;
+	int8_t relay = band_relay(band_find(ui->freq[other])) !=
+	               band_relay(band_find(ui->freq[vfo]));
+	uint16_t level;
+	uint16_t start = tick_fine();
+
+	radio_hop(1, ui->freq[other]);
+	if (relay)
+		_delay_ms(WATCH_RELAY_MS);
+	_delay_us(WATCH_SETTLE_US);
+	
+	// The first sample skips a conversion that started before the settle
+	// time was over, the rest are back to back
+	level = adc_sample();
+	for (uint8_t i = 1; i < (1 << WATCH_SAMPLES_LOG2); ++i)
+	{
+		adc_wait();
+		level += adc_getval_8bit();
+	}
+	radio_hop(0, ui->freq[vfo]);
+	if (relay)
+		_delay_ms(WATCH_RELAY_MS);
+
+	loop->watch_gap = tick_fine() - start;
+	if (loop->watch_gap > loop->watch_gap_max)
+		loop->watch_gap_max = loop->watch_gap;
+	loop->watch_last = tick_now();
+
+	level >>= WATCH_SAMPLES_LOG2;
+	if (ui_smeter_bars(level, UI_WATCH_WIDTH) !=
+	    ui_smeter_bars(loop->watch_level, UI_WATCH_WIDTH))
+		ui_invalidate(loop, UI_SECONDLINE);
+	loop->watch_level = level;
+
+	// Switch over to a busy VFO when the current one is quiet
+	if (loop->watch == WATCH_AUTO && level >= WATCH_THRESHOLD &&
+	    (uint8_t)loop->smeter_last < WATCH_THRESHOLD)
+		button_shortpress(ui, loop);
+}
+
+
+//! \short Run the scanner for a poll round. Never blocks.
+//! \return 1 if something was done
+int8_t ui_scan(ui_t *ui, ui_loop_t *loop)
+{
+	uint16_t elapsed = tick_fine() - loop->scan_since;
+	uint8_t level = adc_getval_8bit();
+	tick_t now = tick_now();
+
+	// Channels per second, counted over one second windows
+	if ((tick_t)(now - loop->scan_window) >= TICKS(1000))
+	{
+		loop->scan_rate = loop->scan_count;
+		loop->scan_count = 0;
+		loop->scan_window = now;
+		ui_invalidate(loop, UI_SECONDLINE);
+	}
+
+	if (loop->scan == SCAN_SETTLE)
+	{
+		if (elapsed < SCAN_SETTLE_US / TICK_FINE_US)
+			return 0;
+
+		// Nothing near the squelch, no need to listen any longer
+		if (level < SCAN_SQUELCH / 2)
+		{
+			ui_scan_next(ui, loop);
+			return 1;
+		}
+		loop->scan = SCAN_DWELL;
+	}
+
+	if (loop->scan == SCAN_DWELL)
+	{
+		if (level >= SCAN_SQUELCH)
+		{
+			loop->scan = SCAN_BUSY;
+			loop->scan_quiet = now;
+			ui_invalidate(loop, UI_SECONDLINE);
+			return 1;
+		}
+		if (elapsed >= (SCAN_SETTLE_US + SCAN_DWELL_US) / TICK_FINE_US)
+		{
+			ui_scan_next(ui, loop);
+			return 1;
+		}
+		return 0;
+	}
+
+	// Busy: resume once the signal has been gone for the hold time
+	if (level >= SCAN_SQUELCH)
+	{
+		loop->scan_quiet = now;
+	}
+	else if ((tick_t)(now - loop->scan_quiet) >= SCAN_HOLD_TICKS)
+	{
+		ui_scan_next(ui, loop);
+		ui_invalidate(loop, UI_SECONDLINE);
+		return 1;
+	}
+	return 0;
 }
 
 
 //! \short Handle long button presses for the UI
 void button_longpress(ui_t *ui)
 {
+	PROF_BEGIN(eeprom);
 	eeprom_write_block(ui, &eeprom_settings_addr, sizeof(ui_t));
+	PROF_END(eeprom, PROF_EEPROM);
 	lcd_row2();
-	lcd_puts("-Settings saved-");
+	lcd_puts_P(PSTR("-Settings saved-"));
 }
 
 
 void ui_new(ui_t *ui)
 {
+	PROF_BEGIN(eeprom);
 	eeprom_read_block(ui, &eeprom_settings_addr, sizeof(ui_t));
+	PROF_END(eeprom, PROF_EEPROM);
 
 	if (ui->magic_num != UI_MAGIC_NUM)
 	{
 		ui->magic_num = UI_MAGIC_NUM;
 		ui->vfo = 0;
-		ui->usb[0] = 0;
-		ui->usb[1] = 1;
-		ui->freq[0] = 3699000;
-		ui->freq[1] = 14267000;
-		ui->step[0] = 2;
-		ui->step[1] = 2;
+		
+		// VFO A on the first band, VFO B on the last one
+		for (int8_t i = 0; i < NUM_VFOS; ++i)
+		{
+			const band_t *band = &bands[i ? NUM_BANDS - 1 : 0];
+			ui->freq[i] = pgm_read_dword(&band->init);
+			ui->usb[i] = pgm_read_byte(&band->usb);
+			ui->step[i] = pgm_read_byte(&band->step);
+		}
 	}
 	
-	// initialize everything
-	lcd_init();
+	// RF first, the display can wait. The DDS setup also runs while the
+	// display is still in its power-on reset.
+	ui->freq[ui->vfo] = radio_init(ui->freq[ui->vfo], ui->usb[ui->vfo]);
+	PROF_MARK(PROF_MARK_RF);
+	ui_band_remember(ui);
+	
+	// initialize everything else
 	adc_init();
-	radio_init();
-	radio_setfreq(ui->freq[ui->vfo], ui->usb[ui->vfo]);
+	lcd_init();
 	
-	const unsigned char zero[] = {21, 00, 00, 00, 00, 00, 21, 00};
-	const unsigned char one[] = {21, 16, 16, 16, 16, 16, 21, 00};
-	const unsigned char two[] = {21, 20, 20, 20, 20, 20, 21, 00};
-	const unsigned char three[] = {21, 21, 21, 21, 21, 21, 21, 00};
-	lcd_custom_char(zero, 0);
-	lcd_custom_char(one, 1);
-	lcd_custom_char(two, 2);
-	lcd_custom_char(three, 3);
+	for (uint8_t i = 0; i < 4; ++i)
+		lcd_custom_char_P(ui_glyphs[i], i);
 	lcd_cmdmode();
 	
 }
 
 
-//! \short Run the UI loop until shut down
-void ui_run(ui_t *ui)
+#if defined(PROFILE) || defined(TRACE)
+#ifdef PROFILE
+// Names of the profiled sections, 8 characters each
+const char prof_names[PROF_NSECTIONS][9] PROGMEM =
+{
+	"DDS cmd ",
+	"LCD nibl",
+	"freq_mul",
+	"bcd2str ",
+	"EEPROM  ",
+	"UI busy ",
+	"UI idle ",
+	"ISR INT0"
+};
+
+// Section pages, the boot page, the frame page and the watch page
+#define UI_DIAG_PROF_PAGES (PROF_NSECTIONS + 3)
+#else
+#define UI_DIAG_PROF_PAGES 0
+#endif
+
+#ifdef TRACE
+// Names of the latency channels, 3 characters each
+const char trace_names[TRACE_NCHANS][4] PROGMEM =
 {
-	ui_draw(ui, UI_FIRSTLINE | UI_SECONDLINE);
+	"RF ",
+	"LCD"
+};
+
+#define UI_DIAG_TRACE_PAGES TRACE_NCHANS
+#else
+#define UI_DIAG_TRACE_PAGES 0
+#endif
 
-	// local step counter and button state
-	int8_t rotation = 0;
-	int8_t button_state = 0;
-	int8_t held_down = 0;
+#define UI_DIAG_PAGES (UI_DIAG_PROF_PAGES + UI_DIAG_TRACE_PAGES)
+
+
+//! \short Print a number right-aligned in the given width.
+void ui_diagnum(uint32_t num, int8_t width)
+{
+	char buf[8];
+	int_to_str(buf, width, num);
+	for (int8_t i = 0; i < width; ++i)
+		lcd_putchar(buf[i]);
+}
+
+
+//! \short Draw a page of the diagnostics.
+void ui_diagdraw(const ui_loop_t *loop, int8_t page)
+{
+#ifdef PROFILE
+	prof_stat_t stat;
+
+	// Section name and call count, average and maximum cycles
+	if (page < PROF_NSECTIONS)
+	{
+		prof_get(page, &stat);
+		
+		lcd_home();
+		lcd_puts_P(prof_names[page]);
+		ui_diagnum(stat.calls, 8);
+		
+		lcd_row2();
+		ui_diagnum(stat.calls ? stat.total / stat.calls : 0, 8);
+		ui_diagnum(stat.max, 8);
+		return;
+	}
+
+	// Cycles from reset to RF and to the first frame
+	if (page == PROF_NSECTIONS)
+	{
+		lcd_home();
+		lcd_puts_P(PSTR("Boot RF "));
+		ui_diagnum(prof_marks[PROF_MARK_RF], 8);
+		
+		lcd_row2();
+		lcd_puts_P(PSTR("Frame   "));
+		ui_diagnum(prof_marks[PROF_MARK_FRAME], 8);
+		return;
+	}
+
+	// Display frames drawn and line updates dropped
+	if (page == PROF_NSECTIONS + 1)
+	{
+		lcd_home();
+		lcd_puts_P(PSTR("Drawn   "));
+		ui_diagnum(loop->frames, 8);
+		
+		lcd_row2();
+		lcd_puts_P(PSTR("Dropped "));
+		ui_diagnum(loop->dropped, 8);
+		return;
+	}
+
+	// Dual watch gap, last and longest, in microseconds
+	if (page == PROF_NSECTIONS + 2)
+	{
+		lcd_home();
+		lcd_puts_P(PSTR("Gap us  "));
+		ui_diagnum((uint32_t)loop->watch_gap * TICK_FINE_US, 8);
+		
+		lcd_row2();
+		lcd_puts_P(PSTR("Max us  "));
+		ui_diagnum((uint32_t)loop->watch_gap_max * TICK_FINE_US, 8);
+		return;
+	}
+#else
+	(void)loop;
+#endif
+
+#ifdef TRACE
+	// Channel name, minimum and average on the first line, 99th
+	// percentile and maximum on the second, in microseconds
+	const trace_hist_t *hist = &trace_hist[page - UI_DIAG_PROF_PAGES];
+	const uint8_t us = F_CPU / 1000000UL;
 	
-	// s-meter values
-	int8_t smeter_last = 0;
-	int8_t smeter_curr = 0;
+	lcd_home();
+	lcd_puts_P(trace_names[page - UI_DIAG_PROF_PAGES]);
+	ui_diagnum(hist->min / us, 6);
+	lcd_putchar(' ');
+	ui_diagnum(hist->count ? hist->total / hist->count / us : 0, 6);
 	
-	// Loop until the device gets shut down
-	while(1)
+	lcd_row2();
+	lcd_puts_P(PSTR("99%"));
+	ui_diagnum(trace_p99(hist) / us, 6);
+	lcd_putchar(' ');
+	ui_diagnum(hist->max / us, 6);
+#endif
+}
+
+
+//! \short Show the diagnostics until the button is pressed.
+//! The encoder scrolls through the pages. With PROFILE, one page per
+//! section: name and call count on the first line, average and maximum
+//! cycles on the second one, followed by a page with the cycle counts from
+//! reset to RF and to the first frame, a page with the display frame
+//! counts and a page with the dual watch gap. With TRACE, one page per
+//! latency channel. A long press clears the statistics.
+void ui_diagpage(ui_loop_t *loop)
+{
+	int8_t page = 0;
+	int8_t button_state;
+
+#ifdef PROFILE
+	prof_paused = 1;
+#endif
+	read_encoder();
+	
+	while (1)
 	{
-		// Normal state
-		if (!held_down)
+		ui_diagdraw(loop, page);
+		
+		// Wait for input
+		int8_t rotation = 0;
+		do
 		{
-			// Read the global encoder rotation var into the local one,
-			// and act accordingly if needed
-			rotation += read_encoder();
-			if (rotation)
-			{
-				rotation = encoder_turned(ui, rotation, 0);
-			}
-			
+			rotation = read_encoder();
 			button_state = read_button(BUTTON_DELAY);
-			if (button_state)
-			{
-				if (button_state == -1)
-				{
-					held_down = 1;
-				}
-				if (button_state == 1)
-				{
-					button_shortpress(ui);
-				}
-				if (button_state == 2)
-				{
-					button_longpress(ui);
-					button_wait();
-					ui_draw(ui, UI_SECONDLINE);
-				}
-				button_state = 0;		
-			}
 		}
-			
-		// Button down + encoder turned == special state until button up
-		else
+		while (!rotation && button_state <= 0);
+		
+		if (button_state == 1)
+			break;
+		if (button_state == 2)
 		{
-			rotation += read_encoder();
-			if (rotation)
+#ifdef PROFILE
+			prof_reset();
+			loop->frames = 0;
+			loop->dropped = 0;
+			loop->watch_gap_max = 0;
+#endif
+#ifdef TRACE
+			trace_reset();
+#endif
+			button_wait();
+		}
+		
+		page += rotation > 0 ? 1 : rotation < 0 ? -1 : 0;
+		if (page < 0)
+			page = UI_DIAG_PAGES - 1;
+		else if (page >= UI_DIAG_PAGES)
+			page = 0;
+	}
+	
+#ifdef PROFILE
+	prof_paused = 0;
+#endif
+	// Scrolling is not a tuning latency
+	TRACE_DISCARD();
+}
+#endif
+
+
+//! \short Draw the whole display and reset the loop state.
+void ui_start(ui_t *ui, ui_loop_t *loop)
+{
+	loop->watch = WATCH_OFF;
+	loop->scan = SCAN_OFF;
+	loop->held_down = 0;
+	ui_draw(ui, loop, UI_FIRSTLINE | UI_SECONDLINE);
+	PROF_MARK(PROF_MARK_FRAME);
+
+	loop->rotation = 0;
+	loop->smeter_last = 0;
+	loop->dirty = 0;
+	loop->last_frame = tick_now();
+	loop->frames = 1;
+	loop->dropped = 0;
+	loop->watch_level = 0;
+	loop->watch_last = loop->last_frame;
+	loop->watch_gap = 0;
+	loop->watch_gap_max = 0;
+}
+
+
+//! \short Run a single iteration of the UI loop.
+//! May block while the button is held down.
+void ui_poll(ui_t *ui, ui_loop_t *loop)
+{
+	PROF_BEGIN(poll);
+	int8_t idle = 1;
+	int8_t button_state;
+	int8_t smeter_curr;
+
+	// Normal state
+	if (!loop->held_down)
+	{
+		// Read the global encoder rotation var into the local one,
+		// and act accordingly if needed
+		loop->rotation += read_encoder();
+		if (loop->rotation)
+		{
+			loop->rotation = encoder_turned(ui, loop, loop->rotation, 0);
+			idle = 0;
+		}
+		
+		button_state = read_button(BUTTON_DELAY);
+		if (button_state)
+		{
+			idle = 0;
+			if (button_state == -1)
 			{
-				rotation = encoder_turned(ui, rotation, 1);
+				loop->held_down = 1;
+				// Show the step instead of the other VFO
+				if (loop->watch)
+					ui_invalidate(loop, UI_SECONDLINE);
 			}
-			if (!button_down())
+			if (button_state == 1)
 			{
-				held_down = 0;
-				rotation = 0;
+				button_shortpress(ui, loop);
+			}
+			if (button_state == 2)
+			{
+				button_longpress(ui);
+				button_wait();
+#if defined(PROFILE) || defined(TRACE)
+				ui_diagpage(loop);
+				ui_draw(ui, loop, UI_FIRSTLINE);
+#endif
+				ui_draw(ui, loop, UI_SECONDLINE);
 			}
 		}
+	}
 		
-		smeter_curr = adc_getval_8bit();
-		if (smeter_curr != smeter_last)
+	// Button down + encoder turned == special state until button up
+	else
+	{
+		loop->rotation += read_encoder();
+		if (loop->rotation)
+		{
+			loop->rotation = encoder_turned(ui, loop, loop->rotation, 1);
+			idle = 0;
+			// Step changes are not traced
+			TRACE_DISCARD();
+		}
+		if (!button_down())
 		{
-			ui->smeter = smeter_last = smeter_curr;
-			ui_draw(ui, UI_SECONDLINE);
+			loop->held_down = 0;
+			loop->rotation = 0;
+			if (loop->watch)
+				ui_invalidate(loop, UI_SECONDLINE);
 		}
 	}
+	
+	// Scanner, paused while the step is being changed
+	if (loop->scan && !loop->held_down && ui_scan(ui, loop))
+		idle = 0;
+
+	// Dual watch, unless the knob is being turned or scanning
+	if (loop->watch && !loop->scan && !loop->held_down && !loop->rotation &&
+	    !encoder_dir &&
+	    (tick_t)(tick_now() - loop->watch_last) >= WATCH_PERIOD_TICKS)
+	{
+		ui_watch(ui, loop);
+		idle = 0;
+	}
+	
+	// Only redraw when the number of bars changes. For a tick after a hop
+	// the receiver is still settling back.
+	smeter_curr = adc_getval_8bit();
+	if (smeter_curr != loop->smeter_last &&
+	    (!loop->watch || (tick_t)(tick_now() - loop->watch_last) > 1))
+	{
+		if (ui_smeter_bars(smeter_curr, 8) !=
+		    ui_smeter_bars(loop->smeter_last, 8))
+			ui_invalidate(loop, UI_SECONDLINE);
+		ui->smeter = loop->smeter_last = smeter_curr;
+		idle = 0;
+	}
+
+	if (ui_flush(ui, loop))
+		idle = 0;
+
+	PROF_END(poll, idle ? PROF_UI_IDLE : PROF_UI_BUSY);
+}
+
+
+//! \short Run the UI loop until shut down
+void ui_run(ui_t *ui)
+{
+	ui_loop_t loop;
+	ui_start(ui, &loop);
+
+	// Loop until the device gets shut down
+	while(1)
+		ui_poll(ui, &loop);
 }
 
 
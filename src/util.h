@@ -11,7 +11,7 @@
 // 2009-07-03 initial version / AN
 
 
-#include <avr/io.h>
+#include <inttypes.h>
 
 
 //! \short Convert an integer to string representation. 